@@ -0,0 +1,479 @@
+#pragma once
+
+#include <cstdlib>
+#include <new>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "core.hpp"
+
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#define FET_ALLOC_AUDIT_HAS_PMR 1
+#endif
+#endif
+
+/* ****************************************************************
+    アロケーション監査
+    audit_alloc(source, stage...) はパイプラインを 1 回流し
+    各ステージの OnConnect / OnNext / OnComplete 中に発生した
+    アロケーション回数とバイト数をステージごとに集計する
+
+    グローバル operator new の計数はオプトイン
+    どれか 1 つの翻訳単位で
+        #define FET_ALLOC_AUDIT_DEFINE_NEW
+        #include "fet/alloc_audit.hpp"
+    とすること (C++17 以降では pmr 用に counting_resource も使える)
+**************************************************************** */
+namespace fet
+{
+
+namespace impl
+{
+
+struct AllocCount
+{
+    size_t calls = 0;
+    size_t bytes = 0;
+};
+
+struct StageAllocStats
+{
+    std::string name;
+    size_t elements = 0;
+    AllocCount connect;
+    AllocCount next;
+    AllocCount complete;
+
+    double calls_per_element() const { return elements ? double(next.calls) / elements : 0; }
+
+    double bytes_per_element() const { return elements ? double(next.bytes) / elements : 0; }
+};
+
+enum class AllocPhase
+{
+    connect,
+    next,
+    complete,
+};
+
+struct AllocReport
+{
+    std::vector<StageAllocStats> stages;
+
+    // 定常状態 (OnNext) でアロケーションしたステージがないか
+    bool steady_state_alloc_free() const
+    {
+        for (const auto &s : stages) {
+            if (s.next.calls) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+inline std::ostream &operator <<(std::ostream &os, const AllocReport &report)
+{
+    os << "stage\telements\tcalls/elem\tbytes/elem\tconnect(calls/bytes)\tcomplete(calls/bytes)\n";
+    for (const auto &s : report.stages) {
+        os << s.name << '\t' << s.elements << '\t' << s.calls_per_element() << '\t' << s.bytes_per_element() << '\t'
+           << s.connect.calls << '/' << s.connect.bytes << '\t' << s.complete.calls << '/' << s.complete.bytes << '\n';
+    }
+    return os;
+}
+
+/* ****************************************************************
+    記録先
+    スレッドごとに「今どのステージのどのフェーズを実行中か」を持つ
+ */
+struct AllocRecorder
+{
+    AllocReport *report = nullptr;
+    size_t stage = 0;
+    AllocPhase phase = AllocPhase::next;
+};
+
+inline AllocRecorder &alloc_recorder()
+{
+    thread_local AllocRecorder recorder;
+    return recorder;
+}
+
+// operator new, counting_resource から呼ばれる
+inline void record_alloc(size_t bytes) noexcept
+{
+    auto &r = alloc_recorder();
+    if (!r.report) {
+        return;
+    }
+    auto &s = r.report->stages[r.stage];
+    auto &c = r.phase == AllocPhase::connect ? s.connect : r.phase == AllocPhase::next ? s.next : s.complete;
+    ++c.calls;
+    c.bytes += bytes;
+}
+
+class AllocScope
+{
+    AllocRecorder &m_rec;
+    size_t m_stage;
+    AllocPhase m_phase;
+
+public:
+    AllocScope(size_t stage, AllocPhase phase):
+        m_rec   (alloc_recorder()),
+        m_stage (m_rec.stage),
+        m_phase (m_rec.phase)
+    {
+        m_rec.stage = stage;
+        m_rec.phase = phase;
+    }
+
+    AllocScope(const AllocScope&) = delete;
+    AllocScope &operator =(const AllocScope&) = delete;
+
+    ~AllocScope()
+    {
+        m_rec.stage = m_stage;
+        m_rec.phase = m_phase;
+    }
+};
+
+#ifdef FET_ALLOC_AUDIT_HAS_PMR
+// 上流の memory_resource へのアロケーションを現在のステージに計上する
+class counting_resource: public std::pmr::memory_resource
+{
+    std::pmr::memory_resource *m_upstream;
+
+public:
+    explicit counting_resource(std::pmr::memory_resource *upstream = std::pmr::get_default_resource()):
+        m_upstream(upstream)
+    { }
+
+private:
+    void *do_allocate(size_t bytes, size_t align) override
+    {
+        record_alloc(bytes);
+        return m_upstream->allocate(bytes, align);
+    }
+
+    void do_deallocate(void *p, size_t bytes, size_t align) override
+    {
+        m_upstream->deallocate(p, bytes, align);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+#endif
+
+/* ****************************************************************
+    監査用ラッパー
+    OnNext の間だけ自分のステージ番号を記録先に設定する
+    下流のラッパーは呼び出し中に自分の番号に切り替え、戻る時に元に戻す
+ */
+
+template <class G>
+class AuditGate: IGate
+{
+    G m_gate;
+    size_t m_id;
+
+public:
+    constexpr AuditGate(G &&gate, size_t id):
+        m_gate (std::forward<G>(gate)),
+        m_id   (id)
+    { }
+
+    template <class E>
+    constexpr auto GetInfo(const SourceInfo<E> &info) const
+    {
+        return m_gate.GetInfo(info);
+    }
+
+    template <class E>
+    auto OnConnect(const SourceInfo<E> &info) const
+    {
+        AllocScope scope(m_id, AllocPhase::connect);
+        return connect_ctx(m_gate, info);
+    }
+
+    template <class CTX, class E, class CB>
+    void OnNext(CTX &ctx, E &&e, CB &&cb) const
+    {
+        AllocScope scope(m_id, AllocPhase::next);
+        ++alloc_recorder().report->stages[m_id].elements;
+        gate_next<0>(m_gate, ctx, std::forward<E>(e), std::forward<CB>(cb));
+    }
+
+    template <class CTX, class E, class CB>
+    void OnError(CTX &ctx, E &&e, CB &&cb) const
+    {
+        AllocScope scope(m_id, AllocPhase::next);
+        gate_next<0>(m_gate, ctx, std::forward<E>(e), std::forward<CB>(cb));
+    }
+
+    template <class CTX, class CB>
+    void OnFlush(CTX &ctx, CB &&cb) const
+    {
+        AllocScope scope(m_id, AllocPhase::complete);
+        gate_flush<0>(m_gate, ctx, std::forward<CB>(cb));
+    }
+};
+
+template <class D>
+class AuditDrain: IDrain
+{
+    D m_drain;
+    size_t m_id;
+
+public:
+    constexpr AuditDrain(D &&drain, size_t id):
+        m_drain (std::forward<D>(drain)),
+        m_id    (id)
+    { }
+
+    template <class E>
+    auto OnConnect(const SourceInfo<E> &info) const
+    {
+        AllocScope scope(m_id, AllocPhase::connect);
+        return connect_ctx(m_drain, info);
+    }
+
+    template <class CTX, class E>
+    void OnNext(CTX &ctx, E &&e) const
+    {
+        AllocScope scope(m_id, AllocPhase::next);
+        ++alloc_recorder().report->stages[m_id].elements;
+        jct_next<0>(m_drain, ctx, std::forward<E>(e));
+    }
+
+    template <class CTX, class E>
+    void OnError(CTX &ctx, E &&e) const
+    {
+        AllocScope scope(m_id, AllocPhase::next);
+        jct_next<0>(m_drain, ctx, std::forward<E>(e));
+    }
+
+    template <class CTX>
+    decltype(auto) OnComplete(CTX && ctx) const {
+        AllocScope scope(m_id, AllocPhase::complete);
+        return m_drain.OnComplete(ctx_of<0, D>(std::move(ctx)));
+    }
+};
+
+template <class P, class D, enable_if<is_drain<D>> = nullptr>
+constexpr decltype(auto) audit_pipe(size_t id, P && p, D && drain) {
+    return std::forward<P>(p) | AuditDrain<D>(std::forward<D>(drain), id);
+}
+
+template <class P, class G, class... St, enable_if<is_gate<G>> = nullptr>
+constexpr decltype(auto) audit_pipe(size_t id, P && p, G && gate, St && ... rest) {
+    return audit_pipe(id + 1, std::forward<P>(p) | AuditGate<G>(std::forward<G>(gate), id), std::forward<St>(rest)...);
+}
+
+// source | stage... | drain を 1 回流し、ステージごとのアロケーションを集計する
+// stages[0] は source (Emit 中で他のステージに属さないもの)
+template <class S, class... St, enable_if<is_src<S>> = nullptr>
+AllocReport audit_alloc(S &&src, St&& ... stages)
+{
+    static_assert(sizeof...(St) > 0, "audit_alloc requires a drain");
+    AllocReport report;
+    report.stages.resize(sizeof...(St) + 1);
+    report.stages[0].name = "source";
+    for (size_t i = 1; i <= sizeof...(St); ++i) {
+        report.stages[i].name = (i == sizeof...(St) ? "drain " : "gate ") + std::to_string(i);
+    }
+
+    auto &rec = alloc_recorder();
+    const auto saved = rec;
+    rec.report = &report;
+    rec.stage = 0;
+    rec.phase = AllocPhase::next;
+    try {
+        audit_pipe(1, std::forward<S>(src), std::forward<St>(stages)...);
+    } catch (...) {
+        rec = saved;
+        throw;
+    }
+    rec = saved;
+    return report;
+}
+
+// 定常状態 (各ステージの OnNext) でアロケーションが発生したら std::logic_error を投げる
+// OnConnect での reserve や OnComplete での確保は許容する
+template <class S, class... St, enable_if<is_src<S>> = nullptr>
+AllocReport assert_no_alloc(S &&src, St&& ... stages)
+{
+    auto report = audit_alloc(std::forward<S>(src), std::forward<St>(stages)...);
+    if (!report.steady_state_alloc_free()) {
+        std::ostringstream os;
+        os << "fet: pipeline allocates per element\n" << report;
+        throw std::logic_error(os.str());
+    }
+    return report;
+}
+
+} // namespace impl
+
+using impl::audit_alloc;
+using impl::assert_no_alloc;
+using impl::AllocReport;
+#ifdef FET_ALLOC_AUDIT_HAS_PMR
+using impl::counting_resource;
+#endif
+
+} // namespace fet
+
+#ifdef FET_ALLOC_AUDIT_DEFINE_NEW
+void *operator new(size_t size)
+{
+    fet::impl::record_alloc(size);
+    if (void *p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size)
+{
+    return ::operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    fet::impl::record_alloc(size);
+    return std::malloc(size ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return ::operator new(size, std::nothrow);
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t&) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t&) noexcept
+{
+    std::free(p);
+}
+
+// over-aligned な型の new も数える
+#ifdef __cpp_aligned_new
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace fet
+{
+namespace impl
+{
+
+inline void *aligned_malloc(size_t size, std::align_val_t align) noexcept
+{
+    const auto a = static_cast<size_t>(align);
+    size = size ? (size + a - 1) / a * a : a;
+#ifdef _WIN32
+    return _aligned_malloc(size, a);
+#else
+    return std::aligned_alloc(a, size);
+#endif
+}
+
+inline void aligned_free(void *p) noexcept
+{
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+} // namespace impl
+} // namespace fet
+
+void *operator new(size_t size, std::align_val_t align)
+{
+    fet::impl::record_alloc(size);
+    if (void *p = fet::impl::aligned_malloc(size, align)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size, std::align_val_t align)
+{
+    return ::operator new(size, align);
+}
+
+void *operator new(size_t size, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+    fet::impl::record_alloc(size);
+    return fet::impl::aligned_malloc(size, align);
+}
+
+void *operator new[](size_t size, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+    return ::operator new(size, align, std::nothrow);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept
+{
+    fet::impl::aligned_free(p);
+}
+
+void operator delete[](void *p, std::align_val_t) noexcept
+{
+    fet::impl::aligned_free(p);
+}
+
+void operator delete(void *p, size_t, std::align_val_t) noexcept
+{
+    fet::impl::aligned_free(p);
+}
+
+void operator delete[](void *p, size_t, std::align_val_t) noexcept
+{
+    fet::impl::aligned_free(p);
+}
+
+void operator delete(void *p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    fet::impl::aligned_free(p);
+}
+
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    fet::impl::aligned_free(p);
+}
+#endif
+#endif
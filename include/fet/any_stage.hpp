@@ -0,0 +1,171 @@
+#pragma once
+
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "core.hpp"
+
+/* ****************************************************************
+    any_source / any_gate / any_drain 共通の型消去用部品
+    - AnyBox: small-buffer optimization 付きの多態オブジェクト入れ物
+    - 仮想関数呼び出しは要素ごとではなく batch 単位で行う
+**************************************************************** */
+namespace fet
+{
+
+namespace impl
+{
+
+// 型消去したステージがまとめて仮想境界を越える要素数の既定値
+constexpr size_t any_batch_size = 256;
+
+class IAny
+{
+public:
+    virtual ~IAny() = default;
+
+    // buf に自身を move 構築して返す (AnyBox の SBO 用)
+    virtual IAny *MoveTo(void *buf) noexcept = 0;
+};
+
+template <class B, class T>
+class AnyImpl: public B
+{
+public:
+    IAny *MoveTo(void *buf) noexcept override
+    {
+        return ::new (buf) T(std::move(static_cast<T&>(*this)));
+    }
+};
+
+template <class B, size_t N = 3 * sizeof(void *)>
+class AnyBox
+{
+    using storage = std::aligned_storage_t<N, alignof(std::max_align_t)>;
+
+    storage m_buf;
+    B *m_ptr;
+
+    template <class T>
+    using is_small = std::integral_constant<bool, sizeof(T) <= N && alignof(std::max_align_t) % alignof(T) == 0 && std::is_nothrow_move_constructible<T>::value>;
+
+    bool is_inline() const noexcept
+    {
+        return m_ptr == reinterpret_cast<const B *>(&m_buf);
+    }
+
+    void reset() noexcept
+    {
+        if (!m_ptr) {
+            return;
+        }
+        if (is_inline()) {
+            m_ptr->~B();
+        } else {
+            delete m_ptr;
+        }
+        m_ptr = nullptr;
+    }
+
+    void steal(AnyBox &other) noexcept
+    {
+        if (!other.m_ptr) {
+            m_ptr = nullptr;
+        } else if (other.is_inline()) {
+            m_ptr = static_cast<B *>(other.m_ptr->MoveTo(&m_buf));
+            other.reset();
+        } else {
+            m_ptr = other.m_ptr;
+            other.m_ptr = nullptr;
+        }
+    }
+
+    template <class T, class... A, enable_if<is_small<T>> = nullptr>
+    static B *create(storage &buf, A&& ... args)
+    {
+        return ::new (&buf) T(std::forward<A>(args)...);
+    }
+
+    template <class T, class... A, enable_if<std::integral_constant<bool, !is_small<T>::value>> = nullptr>
+    static B *create(storage&, A&& ... args)
+    {
+        return new T(std::forward<A>(args)...);
+    }
+
+public:
+    AnyBox() noexcept:
+        m_ptr(nullptr)
+    { }
+
+    template <class T, class... A>
+    static AnyBox make(A&& ... args)
+    {
+        AnyBox box;
+        box.m_ptr = create<T>(box.m_buf, std::forward<A>(args)...);
+        return box;
+    }
+
+    AnyBox(AnyBox &&other) noexcept
+    {
+        steal(other);
+    }
+
+    AnyBox &operator =(AnyBox &&other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            steal(other);
+        }
+        return *this;
+    }
+
+    AnyBox(const AnyBox&) = delete;
+    AnyBox &operator =(const AnyBox&) = delete;
+
+    ~AnyBox()
+    {
+        reset();
+    }
+
+    explicit operator bool() const noexcept { return m_ptr != nullptr; }
+
+    B *operator ->() const noexcept { return m_ptr; }
+
+    B &operator *() const noexcept { return *m_ptr; }
+};
+
+/* ****************************************************************
+    型消去したコンテキスト
+ */
+
+class IAnyCtx: public IAny { };
+
+template <class C>
+class AnyCtxImpl: public AnyImpl<IAnyCtx, AnyCtxImpl<C>>
+{
+public:
+    C value;
+
+    AnyCtxImpl(C &&ctx):
+        value(std::forward<C>(ctx))
+    { }
+};
+
+using AnyCtx = AnyBox<IAnyCtx>;
+
+template <class C>
+AnyCtx make_any_ctx(C &&ctx)
+{
+    return AnyCtx::make<AnyCtxImpl<C>>(std::forward<C>(ctx));
+}
+
+template <class C>
+C &any_ctx_cast(AnyCtx &ctx)
+{
+    return static_cast<AnyCtxImpl<C>&>(*ctx).value;
+}
+
+} // namespace impl
+
+} // namespace fet
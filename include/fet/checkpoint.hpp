@@ -0,0 +1,444 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <locale>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "context.hpp"
+
+/* ****************************************************************
+    コンテキストのバイナリ表現 (チェックポイント用)
+    整数は可変長 (符号付きは zigzag)、浮動小数点数はそのままのバイト列
+    コンテナは要素数 + 要素
+
+    対応する型
+        算術型, enum, nullptr_t, 空クラス
+        std::basic_string, std::pair, std::tuple, std::array, Context
+        push_back() を持つコンテナ (vector, deque, list)
+        insert() を持つ連想コンテナ (set, map, unordered_*)
+            要素はデフォルト構築してから読み込むので、要素型はデフォルト構築可能であること
+        標準の乱数エンジン (ストリーム入出力のテキスト表現)
+    それ以外は checkpoint_codec<T> を特殊化する (drain のコンテキストは drain のヘッダで特殊化する)
+        static void save(CheckpointWriter&, const T&);
+        static void load(CheckpointReader&, T&);
+**************************************************************** */
+namespace fet
+{
+
+namespace impl
+{
+
+class CheckpointWriter
+{
+    std::string m_buf;
+
+public:
+    void PutVarint(uint64_t v)
+    {
+        while (v >= 0x80) {
+            m_buf.push_back(static_cast<char>((v & 0x7f) | 0x80));
+            v >>= 7;
+        }
+        m_buf.push_back(static_cast<char>(v));
+    }
+
+    void PutBytes(const void *p, size_t n)
+    {
+        m_buf.append(static_cast<const char *>(p), n);
+    }
+
+    void clear() { m_buf.clear(); }
+
+    const std::string &data() const { return m_buf; }
+};
+
+class CheckpointReader
+{
+    const char *m_p;
+    const char *m_end;
+
+    [[noreturn]] static void Truncated()
+    {
+        throw std::runtime_error("fet: truncated checkpoint");
+    }
+
+public:
+    explicit CheckpointReader(const std::string &data):
+        m_p   (data.data()),
+        m_end (data.data() + data.size())
+    { }
+
+    uint64_t GetVarint()
+    {
+        uint64_t v = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            if (m_p == m_end) {
+                Truncated();
+            }
+            const auto b = static_cast<unsigned char>(*m_p++);
+            v |= static_cast<uint64_t>(b & 0x7f) << shift;
+            if (!(b & 0x80)) {
+                return v;
+            }
+        }
+        throw std::runtime_error("fet: malformed checkpoint");
+    }
+
+    void GetBytes(void *p, size_t n)
+    {
+        if (static_cast<size_t>(m_end - m_p) < n) {
+            Truncated();
+        }
+        std::memcpy(p, m_p, n);
+        m_p += n;
+    }
+
+    // 要素数として読む (残りのバイト数を超える値は壊れているとみなす)
+    size_t GetSize()
+    {
+        const uint64_t n = GetVarint();
+        if (n > static_cast<uint64_t>(m_end - m_p)) {
+            Truncated();
+        }
+        return static_cast<size_t>(n);
+    }
+
+    bool empty() const { return m_p == m_end; }
+};
+
+template <class T, class = void>
+struct checkpoint_codec;
+
+template <class T>
+void checkpoint_put(CheckpointWriter &w, const T &v)
+{
+    checkpoint_codec<rm_cvref_t<T>>::save(w, v);
+}
+
+template <class T>
+void checkpoint_get(CheckpointReader &r, T &v)
+{
+    checkpoint_codec<rm_cvref_t<T>>::load(r, v);
+}
+
+// 状態を持たない
+template <class T>
+struct checkpoint_codec<T, std::enable_if_t<std::is_empty<T>::value || std::is_same<T, std::nullptr_t>::value>>
+{
+    static void save(CheckpointWriter&, const T&) { }
+
+    static void load(CheckpointReader&, T&) { }
+};
+
+template <class T>
+struct checkpoint_codec<T, std::enable_if_t<std::is_integral<T>::value && std::is_unsigned<T>::value>>
+{
+    static void save(CheckpointWriter &w, const T &v)
+    {
+        w.PutVarint(v);
+    }
+
+    static void load(CheckpointReader &r, T &v)
+    {
+        v = static_cast<T>(r.GetVarint());
+    }
+};
+
+template <class T>
+struct checkpoint_codec<T, std::enable_if_t<std::is_integral<T>::value && std::is_signed<T>::value>>
+{
+    static void save(CheckpointWriter &w, const T &v)
+    {
+        const auto s = static_cast<int64_t>(v);
+        w.PutVarint((static_cast<uint64_t>(s) << 1) ^ static_cast<uint64_t>(s >> 63));
+    }
+
+    static void load(CheckpointReader &r, T &v)
+    {
+        const uint64_t u = r.GetVarint();
+        v = static_cast<T>(static_cast<int64_t>((u >> 1) ^ (~(u & 1) + 1)));
+    }
+};
+
+template <class T>
+struct checkpoint_codec<T, std::enable_if_t<std::is_floating_point<T>::value>>
+{
+    static void save(CheckpointWriter &w, const T &v)
+    {
+        w.PutBytes(&v, sizeof(T));
+    }
+
+    static void load(CheckpointReader &r, T &v)
+    {
+        r.GetBytes(&v, sizeof(T));
+    }
+};
+
+template <class T>
+struct checkpoint_codec<T, std::enable_if_t<std::is_enum<T>::value>>
+{
+    using U = std::underlying_type_t<T>;
+
+    static void save(CheckpointWriter &w, const T &v)
+    {
+        checkpoint_put(w, static_cast<U>(v));
+    }
+
+    static void load(CheckpointReader &r, T &v)
+    {
+        U u;
+        checkpoint_get(r, u);
+        v = static_cast<T>(u);
+    }
+};
+
+template <class Ch, class Tr, class A>
+struct checkpoint_codec<std::basic_string<Ch, Tr, A>, std::enable_if_t<!std::is_empty<std::basic_string<Ch, Tr, A>>::value>>
+{
+    static void save(CheckpointWriter &w, const std::basic_string<Ch, Tr, A> &v)
+    {
+        w.PutVarint(v.size());
+        w.PutBytes(v.data(), v.size() * sizeof(Ch));
+    }
+
+    static void load(CheckpointReader &r, std::basic_string<Ch, Tr, A> &v)
+    {
+        const size_t n = r.GetSize();
+        v.resize(n);
+        r.GetBytes(&v[0], n * sizeof(Ch));
+    }
+};
+
+template <class A, class B>
+struct checkpoint_codec<std::pair<A, B>, std::enable_if_t<!std::is_empty<std::pair<A, B>>::value>>
+{
+    static void save(CheckpointWriter &w, const std::pair<A, B> &v)
+    {
+        checkpoint_put(w, v.first);
+        checkpoint_put(w, v.second);
+    }
+
+    static void load(CheckpointReader &r, std::pair<A, B> &v)
+    {
+        checkpoint_get(r, v.first);
+        checkpoint_get(r, v.second);
+    }
+};
+
+// tuple, array, Context は要素を順に並べる
+template <class T>
+struct checkpoint_elements
+{
+    template <size_t... I>
+    static void save(CheckpointWriter &w, const T &v, std::index_sequence<I ...>)
+    {
+        using std::get;
+        using expand = int[];
+        (void)expand { 0, (checkpoint_put(w, get<I>(v)), 0)... };
+    }
+
+    template <size_t... I>
+    static void load(CheckpointReader &r, T &v, std::index_sequence<I ...>)
+    {
+        using std::get;
+        using expand = int[];
+        (void)expand { 0, (checkpoint_get(r, get<I>(v)), 0)... };
+    }
+};
+
+template <class... T>
+struct checkpoint_codec<std::tuple<T ...>, std::enable_if_t<!std::is_empty<std::tuple<T ...>>::value>>
+{
+    static void save(CheckpointWriter &w, const std::tuple<T ...> &v)
+    {
+        checkpoint_elements<std::tuple<T ...>>::save(w, v, std::index_sequence_for<T ...>());
+    }
+
+    static void load(CheckpointReader &r, std::tuple<T ...> &v)
+    {
+        checkpoint_elements<std::tuple<T ...>>::load(r, v, std::index_sequence_for<T ...>());
+    }
+};
+
+template <class T, size_t N>
+struct checkpoint_codec<std::array<T, N>, std::enable_if_t<!std::is_empty<std::array<T, N>>::value>>
+{
+    static void save(CheckpointWriter &w, const std::array<T, N> &v)
+    {
+        checkpoint_elements<std::array<T, N>>::save(w, v, std::make_index_sequence<N>());
+    }
+
+    static void load(CheckpointReader &r, std::array<T, N> &v)
+    {
+        checkpoint_elements<std::array<T, N>>::load(r, v, std::make_index_sequence<N>());
+    }
+};
+
+template <class... C>
+struct checkpoint_codec<Context<C ...>, std::enable_if_t<!std::is_empty<Context<C ...>>::value>>
+{
+    static void save(CheckpointWriter &w, const Context<C ...> &v)
+    {
+        checkpoint_elements<Context<C ...>>::save(w, v, std::index_sequence_for<C ...>());
+    }
+
+    static void load(CheckpointReader &r, Context<C ...> &v)
+    {
+        checkpoint_elements<Context<C ...>>::load(r, v, std::index_sequence_for<C ...>());
+    }
+};
+
+template <class T, class = void>
+struct is_random_engine: std::false_type { };
+
+template <class T>
+struct is_random_engine<T, typename voider<typename T::result_type, decltype(std::declval<T&>().discard(1ULL)), decltype(std::declval<std::ostream&>() << std::declval<const T&>()), decltype(std::declval<std::istream&>() >> std::declval<T&>())>::type>: std::true_type { };
+
+// 状態は標準のテキスト表現でしか取り出せないので、その文字列を保存する
+template <class T>
+struct checkpoint_codec<T, std::enable_if_t<is_random_engine<T>::value && !std::is_empty<T>::value>>
+{
+    static void save(CheckpointWriter &w, const T &v)
+    {
+        std::ostringstream os;
+        os.imbue(std::locale::classic());
+        os << v;
+        checkpoint_put(w, os.str());
+    }
+
+    static void load(CheckpointReader &r, T &v)
+    {
+        std::string s;
+        checkpoint_get(r, s);
+        std::istringstream is(s);
+        is.imbue(std::locale::classic());
+        is >> v;
+        if (!is) {
+            throw std::runtime_error("fet: malformed checkpoint");
+        }
+    }
+};
+
+template <class T>
+struct is_basic_string: std::false_type { };
+
+template <class Ch, class Tr, class A>
+struct is_basic_string<std::basic_string<Ch, Tr, A>>: std::true_type { };
+
+template <class T, class = void>
+struct is_seq_ctr: std::false_type { };
+
+template <class T>
+struct is_seq_ctr<T, typename voider<decltype(std::declval<T&>().push_back(std::declval<typename T::value_type>())), decltype(std::declval<T&>().clear())>::type>: std::true_type { };
+
+template <class T, class = void>
+struct is_assoc_ctr: std::false_type { };
+
+template <class T>
+struct is_assoc_ctr<T, typename voider<typename T::key_type, decltype(std::declval<T&>().insert(std::declval<typename T::value_type>()))>::type>: std::true_type { };
+
+template <class T, class = void>
+struct has_reserve: std::false_type { };
+
+template <class T>
+struct has_reserve<T, typename voider<decltype(std::declval<T&>().reserve(size_t()))>::type>: std::true_type { };
+
+template <class T, enable_if<has_reserve<T>> = nullptr>
+void checkpoint_reserve(T &v, size_t n)
+{
+    v.reserve(n);
+}
+
+template <class T, enable_if<std::integral_constant<bool, !has_reserve<T>::value>> = nullptr>
+void checkpoint_reserve(T&, size_t)
+{ }
+
+// 連想コンテナの value_type は pair<const K, V> なので const を外して読む
+template <class T, class = void>
+struct checkpoint_elem
+{
+    using type = typename T::value_type;
+};
+
+template <class T>
+struct checkpoint_elem<T, typename voider<typename T::mapped_type>::type>
+{
+    using type = std::pair<typename T::key_type, typename T::mapped_type>;
+};
+
+template <class T>
+struct checkpoint_codec<T, std::enable_if_t<(is_seq_ctr<T>::value || is_assoc_ctr<T>::value) && !is_basic_string<T>::value && !std::is_empty<T>::value>>
+{
+    using elem_t = typename checkpoint_elem<T>::type;
+
+    static void save(CheckpointWriter &w, const T &v)
+    {
+        w.PutVarint(static_cast<uint64_t>(std::distance(std::begin(v), std::end(v))));
+        for (const auto &e : v) {
+            checkpoint_put(w, e);
+        }
+    }
+
+    template <class U, enable_if<is_seq_ctr<U>> = nullptr>
+    static void Add(U &v, elem_t &&e)
+    {
+        v.push_back(std::move(e));
+    }
+
+    template <class U, enable_if<std::integral_constant<bool, !is_seq_ctr<U>::value>> = nullptr>
+    static void Add(U &v, elem_t &&e)
+    {
+        v.insert(std::move(e));
+    }
+
+    // 要素はデフォルト構築してから読み込む
+    static void load(CheckpointReader &r, T &v)
+    {
+        static_assert(std::is_default_constructible<elem_t>::value, "checkpoint_codec for containers requires default constructible elements");
+        const size_t n = r.GetSize();
+        v.clear();
+        checkpoint_reserve(v, n);
+        for (size_t i = 0; i < n; ++i) {
+            elem_t e {};
+            checkpoint_get(r, e);
+            Add(v, std::move(e));
+        }
+    }
+};
+
+// 値をバイナリにする / バイナリから戻す
+template <class T>
+std::string checkpoint_save(const T &v)
+{
+    CheckpointWriter w;
+    checkpoint_put(w, v);
+    return w.data();
+}
+
+template <class T>
+void checkpoint_load(const std::string &data, T &v)
+{
+    CheckpointReader r(data);
+    checkpoint_get(r, v);
+    if (!r.empty()) {
+        throw std::runtime_error("fet: trailing bytes in checkpoint");
+    }
+}
+
+} // namespace impl
+
+using impl::checkpoint_codec;
+using impl::checkpoint_load;
+using impl::checkpoint_save;
+using impl::CheckpointReader;
+using impl::CheckpointWriter;
+
+} // namespace fet
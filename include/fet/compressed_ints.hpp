@@ -0,0 +1,183 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "util.hpp"
+
+/* ****************************************************************
+    整数列の圧縮表現
+    block_size 個ずつのブロックに分け、各ブロックを
+        先頭値 + (差分 - 差分の最小値) のビットパック
+    で保持する (delta + frame-of-reference)
+    ソート済み ID 列なら 1 要素あたり数ビットになる
+**************************************************************** */
+namespace fet
+{
+
+namespace impl
+{
+
+template <class T>
+class CompressedInts
+{
+    static_assert(std::is_integral<T>::value && !std::is_same<T, bool>::value, "CompressedInts requires a non-bool integral type");
+
+public:
+    using value_type = T;
+
+    static constexpr size_t block_size = 128;
+
+private:
+    using U = std::make_unsigned_t<T>;
+    using S = std::make_signed_t<T>;
+
+    static constexpr size_t word_bits = 64;
+
+    struct Block
+    {
+        U first;
+        U min_delta;
+        size_t offset;
+        uint8_t bits;
+        uint8_t count;
+    };
+
+    static_assert(block_size <= std::numeric_limits<uint8_t>::max(), "block count must fit in uint8_t");
+
+    std::vector<Block> m_blocks;
+    std::vector<uint64_t> m_words;
+    size_t m_size = 0;
+    size_t m_bitpos = 0;
+
+    static uint8_t BitWidth(U v)
+    {
+        uint8_t n = 0;
+        for (; v; v >>= 1) {
+            ++n;
+        }
+        return n;
+    }
+
+    void Put(U v, uint8_t bits)
+    {
+        const size_t idx = m_bitpos / word_bits;
+        const size_t shift = m_bitpos % word_bits;
+        m_words[idx] |= static_cast<uint64_t>(v) << shift;
+        if (shift + bits > word_bits) {
+            m_words[idx + 1] |= static_cast<uint64_t>(v) >> (word_bits - shift);
+        }
+        m_bitpos += bits;
+    }
+
+    // ビット幅 B 固定の展開ループ (シフト量とマスクの計算を B で特殊化する)
+    template <size_t B>
+    static void Unpack(const uint64_t *words, size_t bitpos, size_t n, U *out)
+    {
+        constexpr uint64_t mask = B >= word_bits ? ~uint64_t(0) : (uint64_t(1) << B) - 1;
+        for (size_t i = 0; i < n; ++i, bitpos += B) {
+            const size_t idx = bitpos / word_bits;
+            const size_t shift = bitpos % word_bits;
+            uint64_t v = words[idx] >> shift;
+            if (shift + B > word_bits) {
+                v |= words[idx + 1] << (word_bits - shift);
+            }
+            out[i] = static_cast<U>(v & mask);
+        }
+    }
+
+    template <size_t... B>
+    static void Unpack(uint8_t bits, const uint64_t *words, size_t bitpos, size_t n, U *out, std::index_sequence<B ...>)
+    {
+        using unpack_t = void (*)(const uint64_t *, size_t, size_t, U *);
+        static constexpr unpack_t table[] = { &Unpack<B + 1>... };
+        table[bits - 1](words, bitpos, n, out);
+    }
+
+public:
+    size_t size() const { return m_size; }
+
+    bool empty() const { return m_size == 0; }
+
+    size_t block_count() const { return m_blocks.size(); }
+
+    // 圧縮後のおおよそのバイト数
+    size_t memory_size() const
+    {
+        return m_blocks.size() * sizeof(Block) + m_words.size() * sizeof(uint64_t);
+    }
+
+    void reserve(size_t n)
+    {
+        m_blocks.reserve((n + block_size - 1) / block_size);
+    }
+
+    // 1 ブロック分 (n <= block_size) を追加する
+    // 最後以外のブロックが短くてもよい (要素数はブロックごとに持つ)
+    void append_block(const T *first, size_t n)
+    {
+        if (n > block_size) {
+            throw std::invalid_argument("fet: compressed_ints block exceeds block_size");
+        }
+        if (n == 0) {
+            return;
+        }
+        Block blk { static_cast<U>(first[0]), 0, m_bitpos, 0, static_cast<uint8_t>(n) };
+        if (n > 1) {
+            S min = std::numeric_limits<S>::max();
+            for (size_t i = 1; i < n; ++i) {
+                const S d = static_cast<S>(static_cast<U>(static_cast<U>(first[i]) - static_cast<U>(first[i - 1])));
+                min = d < min ? d : min;
+            }
+            blk.min_delta = static_cast<U>(min);
+            U max = 0;
+            for (size_t i = 1; i < n; ++i) {
+                const U v = static_cast<U>(static_cast<U>(first[i]) - static_cast<U>(first[i - 1]) - blk.min_delta);
+                max = v > max ? v : max;
+            }
+            blk.bits = BitWidth(max);
+        }
+        m_words.resize((m_bitpos + blk.bits * (n - 1) + word_bits - 1) / word_bits + 1, 0);
+        if (blk.bits) {
+            for (size_t i = 1; i < n; ++i) {
+                Put(static_cast<U>(static_cast<U>(first[i]) - static_cast<U>(first[i - 1]) - blk.min_delta), blk.bits);
+            }
+        }
+        m_blocks.push_back(blk);
+        m_size += n;
+    }
+
+    // i 番目のブロックを out に展開し、要素数を返す
+    size_t decode_block(size_t i, T *out) const
+    {
+        const auto &blk = m_blocks[i];
+        const size_t n = blk.count;
+        U *u = reinterpret_cast<U *>(out);
+        u[0] = blk.first;
+        if (blk.bits) {
+            Unpack(blk.bits, m_words.data(), blk.offset, n - 1, u + 1, std::make_index_sequence<sizeof(U) * 8>());
+        } else {
+            for (size_t j = 1; j < n; ++j) {
+                u[j] = 0;
+            }
+        }
+        for (size_t j = 1; j < n; ++j) {
+            u[j] = static_cast<U>(u[j - 1] + blk.min_delta + u[j]);
+        }
+        return n;
+    }
+};
+
+template <class T>
+constexpr size_t CompressedInts<T>::block_size;
+
+} // namespace impl
+
+template <class T>
+using compressed_ints = impl::CompressedInts<T>;
+
+} // namespace fet
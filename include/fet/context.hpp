@@ -0,0 +1,450 @@
+#pragma once
+
+#include <tuple>
+
+#include "expected.hpp"
+#include "util.hpp"
+
+/* ****************************************************************
+    パイプラインのコンテキスト
+    OnConnect() の戻り値を 1 段ずつ std::pair でネストさせず
+    Context<CTX1, CTX2, ...> という 1 つのフラットな集成体に並べる
+
+    - std::nullptr_t (ステートレス) のスロットはメモリを持たない
+    - 空クラスのスロットは EBO で消える
+**************************************************************** */
+namespace fet
+{
+
+namespace impl
+{
+
+template <class = void>
+struct NullContext
+{
+    static std::nullptr_t value;
+};
+
+template <class V>
+std::nullptr_t NullContext<V>::value = nullptr;
+
+template <class T>
+using is_ebo_ctx = and_t<std::is_class<T>, std::is_empty<T>, std::integral_constant<bool, !std::is_final<T>::value>>;
+
+// ワーカーごとに複製しても統合の必要がないコンテキスト
+template <class T>
+using is_stateless_ctx = std::integral_constant<bool, std::is_same<T, std::nullptr_t>::value || std::is_empty<T>::value>;
+
+// フラットなコンテキスト CTX の I 番目から (J の個数) 個がすべてステートレスか
+template <size_t I, class CTX, class J>
+struct is_stateless_slots;
+
+template <size_t I, class CTX, size_t... J>
+struct is_stateless_slots<I, CTX, std::index_sequence<J ...>>: and_t<std::true_type, is_stateless_ctx<std::tuple_element_t<I + J, CTX>>...> { };
+
+template <size_t I, class T, class = void>
+class ContextSlot
+{
+    T m_value;
+
+public:
+    constexpr ContextSlot(T &&value):
+        m_value(std::forward<T>(value))
+    { }
+
+    constexpr T &get() & noexcept { return m_value; }
+
+    constexpr const T &get() const & noexcept { return m_value; }
+
+    constexpr T &&get() && noexcept { return std::forward<T>(m_value); }
+};
+
+// ステートレス
+template <size_t I>
+class ContextSlot<I, std::nullptr_t, void>
+{
+public:
+    constexpr ContextSlot(std::nullptr_t)
+    { }
+
+    constexpr std::nullptr_t &get() const & noexcept { return NullContext<>::value; }
+
+    constexpr std::nullptr_t get() && noexcept { return nullptr; }
+};
+
+// 空クラスは EBO
+template <size_t I, class T>
+class ContextSlot<I, T, std::enable_if_t<is_ebo_ctx<T>::value>>: T
+{
+public:
+    constexpr ContextSlot(T &&value):
+        T(std::move(value))
+    { }
+
+    constexpr T &get() & noexcept { return *this; }
+
+    constexpr const T &get() const & noexcept { return *this; }
+
+    constexpr T &&get() && noexcept { return std::move(*this); }
+};
+
+template <class I, class... C>
+class ContextImpl;
+
+template <size_t... I, class... C>
+class ContextImpl<std::index_sequence<I ...>, C ...>: public ContextSlot<I, C>...
+{
+public:
+    constexpr ContextImpl(C&& ... ctx):
+        ContextSlot<I, C>(std::forward<C>(ctx))...
+    { }
+};
+
+template <class... C>
+class Context: public ContextImpl<std::index_sequence_for<C ...>, C ...>
+{
+public:
+    using ContextImpl<std::index_sequence_for<C ...>, C ...>::ContextImpl;
+};
+
+template <size_t I, class T>
+constexpr ContextSlot<I, T> &get_slot(ContextSlot<I, T> &slot) noexcept
+{
+    return slot;
+}
+
+template <size_t I, class T>
+constexpr const ContextSlot<I, T> &get_slot(const ContextSlot<I, T> &slot) noexcept
+{
+    return slot;
+}
+
+template <size_t I, class... C>
+constexpr decltype(auto) get(Context<C ...> & ctx) noexcept {
+    return get_slot<I>(ctx).get();
+}
+
+template <size_t I, class... C>
+constexpr decltype(auto) get(const Context<C ...> & ctx) noexcept {
+    return get_slot<I>(ctx).get();
+}
+
+template <size_t I, class... C>
+constexpr decltype(auto) get(Context<C ...> && ctx) noexcept {
+    return std::move(get_slot<I>(ctx)).get();
+}
+
+template <class T>
+struct is_context: std::false_type { };
+
+template <class... C>
+struct is_context<Context<C ...>>: std::true_type { };
+
+template <class... C1, class... C2, size_t... I1, size_t... I2>
+constexpr auto _ctx_cat(Context<C1 ...> &&ctx1, Context<C2 ...> &&ctx2, std::index_sequence<I1 ...>, std::index_sequence<I2 ...>)
+{
+    return Context<C1 ..., C2 ...> {
+        get<I1>(std::move(ctx1))..., get<I2>(std::move(ctx2))...
+    };
+}
+
+// 2 つのコンテキストを連結する
+template <class... C1, class... C2>
+constexpr auto ctx_cat(Context<C1 ...> &&ctx1, Context<C2 ...> &&ctx2)
+{
+    return _ctx_cat(std::move(ctx1), std::move(ctx2), std::index_sequence_for<C1 ...>(), std::index_sequence_for<C2 ...>());
+}
+
+template <size_t N, class... C, size_t... I>
+constexpr auto _ctx_drop(Context<C ...> &&ctx, std::index_sequence<I ...>)
+{
+    return Context<std::tuple_element_t<N + I, std::tuple<C ...>>...> {
+        get<N + I>(std::move(ctx))...
+    };
+}
+
+// 先頭 N 個のスロットを取り除く
+template <size_t N, class... C>
+constexpr auto ctx_drop(Context<C ...> &&ctx)
+{
+    return _ctx_drop<N>(std::move(ctx), std::make_index_sequence<sizeof...(C) - N>());
+}
+
+/* ****************************************************************
+    ステージ (gate, junction, drain) のスロット数
+    複合ステージ (Junction, Gate, Drain) は ctx_size を公開し
+    自身のコンテキストを親のフラットなコンテキストに展開する
+ */
+
+template <class... T>
+struct voider
+{
+    using type = void;
+};
+
+template <class S, class = void>
+struct is_composite: std::false_type { };
+
+template <class S>
+struct is_composite<S, typename voider<typename rm_cvref_t<S>::ctx_size>::type>: std::true_type { };
+
+template <class S, class = void>
+struct ctx_size_of: std::integral_constant<size_t, 1> { };
+
+template <class S>
+struct ctx_size_of<S, std::enable_if_t<is_composite<S>::value>>: rm_cvref_t<S>::ctx_size { };
+
+// ステージの OnConnect() をフラットなコンテキストとして取得
+template <class S, class I, enable_if<is_composite<S>> = nullptr>
+constexpr auto connect_ctx(const S &stage, const I &info)
+{
+    return stage.OnConnect(info);
+}
+
+template <class S, class I, enable_if<std::integral_constant<bool, !is_composite<S>::value>> = nullptr>
+constexpr auto connect_ctx(const S &stage, const I &info)
+{
+    return Context<decltype(stage.OnConnect(info))> { stage.OnConnect(info) };
+}
+
+/* ****************************************************************
+    エラーチャネル
+    Unexpected<E> は通常の要素と同じコールバックで流れる
+    - OnError() を持つステージはそれで受け取る
+    - OnError() を持たない gate は素通りさせる
+    - OnError() を持たない drain は捨てる
+    ディスパッチ自体は例外を投げない (noexcept はステージの OnNext / OnError に従う)
+ */
+
+template <class S, class C, class E, class CB, class = void>
+struct has_gate_error: std::false_type { };
+
+template <class S, class C, class E, class CB>
+struct has_gate_error<S, C, E, CB, typename voider<decltype(std::declval<const rm_cvref_t<S>&>().OnError(std::declval<C&>(), std::declval<E>(), std::declval<CB>()))>::type>: std::true_type { };
+
+template <class S, class C, class E, class = void>
+struct has_drain_error: std::false_type { };
+
+template <class S, class C, class E>
+struct has_drain_error<S, C, E, typename voider<decltype(std::declval<const rm_cvref_t<S>&>().OnError(std::declval<C&>(), std::declval<E>()))>::type>: std::true_type { };
+
+template <class E>
+using is_value_elem = std::integral_constant<bool, !is_unexpected<rm_cvref_t<E>>::value>;
+
+template <class E>
+using is_error_elem = is_unexpected<rm_cvref_t<E>>;
+
+// 単体の gate に 1 要素を渡す (C は gate 自身のコンテキスト)
+template <class S, class C, class E, class CB, enable_if<is_value_elem<E>> = nullptr>
+constexpr decltype(auto) stage_next(const S & stage, C & ctx, E && e, CB && cb) noexcept(noexcept(stage.OnNext(ctx, std::forward<E>(e), std::forward<CB>(cb)))) {
+    return stage.OnNext(ctx, std::forward<E>(e), std::forward<CB>(cb));
+}
+
+template <class S, class C, class E, class CB, enable_if<is_error_elem<E>, has_gate_error<S, C, E, CB>> = nullptr>
+constexpr decltype(auto) stage_next(const S & stage, C & ctx, E && e, CB && cb) noexcept(noexcept(stage.OnError(ctx, std::forward<E>(e), std::forward<CB>(cb)))) {
+    return stage.OnError(ctx, std::forward<E>(e), std::forward<CB>(cb));
+}
+
+template <class S, class C, class E, class CB, enable_if<is_error_elem<E>, std::integral_constant<bool, !has_gate_error<S, C, E, CB>::value>> = nullptr>
+constexpr void stage_next(const S&, C&, E &&e, CB &&cb) noexcept(noexcept(std::forward<CB>(cb)(std::forward<E>(e))))
+{
+    std::forward<CB>(cb)(std::forward<E>(e));
+}
+
+// 単体の drain に 1 要素を渡す (C は drain 自身のコンテキスト)
+// 複合 drain は内部の gate でディスパッチするのでそのまま OnNext() を呼ぶ
+template <class S, class C, class E, enable_if<std::integral_constant<bool, is_composite<S>::value || is_value_elem<E>::value>> = nullptr>
+constexpr decltype(auto) drain_next(const S & stage, C & ctx, E && e) noexcept(noexcept(stage.OnNext(ctx, std::forward<E>(e)))) {
+    return stage.OnNext(ctx, std::forward<E>(e));
+}
+
+template <class S, class C, class E, enable_if<std::integral_constant<bool, !is_composite<S>::value>, is_error_elem<E>, has_drain_error<S, C, E>> = nullptr>
+constexpr decltype(auto) drain_next(const S & stage, C & ctx, E && e) noexcept(noexcept(stage.OnError(ctx, std::forward<E>(e)))) {
+    return stage.OnError(ctx, std::forward<E>(e));
+}
+
+template <class S, class C, class E, enable_if<std::integral_constant<bool, !is_composite<S>::value>, is_error_elem<E>, std::integral_constant<bool, !has_drain_error<S, C, E>::value>> = nullptr>
+constexpr void drain_next(const S&, C&, E&&) noexcept
+{ }
+
+// フラットなコンテキストの I 番目から始まるステージの OnNext() を呼ぶ
+template <size_t I, class S, class CTX, class E, class CB, enable_if<is_composite<S>> = nullptr>
+constexpr decltype(auto) gate_next(const S & stage, CTX & ctx, E && e, CB && cb) noexcept(noexcept(stage.template OnNextAt<I>(ctx, std::forward<E>(e), std::forward<CB>(cb)))) {
+    return stage.template OnNextAt<I>(ctx, std::forward<E>(e), std::forward<CB>(cb));
+}
+
+template <size_t I, class S, class CTX, class E, class CB, enable_if<std::integral_constant<bool, !is_composite<S>::value>> = nullptr>
+constexpr decltype(auto) gate_next(const S & stage, CTX & ctx, E && e, CB && cb) noexcept(noexcept(stage_next(stage, get<I>(ctx), std::forward<E>(e), std::forward<CB>(cb)))) {
+    return stage_next(stage, get<I>(ctx), std::forward<E>(e), std::forward<CB>(cb));
+}
+
+template <size_t I, class S, class CTX, class E, enable_if<is_composite<S>> = nullptr>
+constexpr decltype(auto) jct_next(const S & stage, CTX & ctx, E && e) noexcept(noexcept(stage.template OnNextAt<I>(ctx, std::forward<E>(e)))) {
+    return stage.template OnNextAt<I>(ctx, std::forward<E>(e));
+}
+
+template <size_t I, class S, class CTX, class E, enable_if<std::integral_constant<bool, !is_composite<S>::value>> = nullptr>
+constexpr decltype(auto) jct_next(const S & stage, CTX & ctx, E && e) noexcept(noexcept(drain_next(stage, get<I>(ctx), std::forward<E>(e)))) {
+    return drain_next(stage, get<I>(ctx), std::forward<E>(e));
+}
+
+template <size_t I, class S, class CTX, class CB, class = void>
+struct has_flush: std::false_type { };
+
+template <size_t I, class S, class CTX, class CB>
+struct has_flush<I, S, CTX, CB, typename voider<decltype(std::declval<const rm_cvref_t<S>&>().OnFlush(get<I>(std::declval<CTX&>()), std::declval<CB>()))>::type>: std::true_type { };
+
+// 終端で gate が溜めている要素を吐き出させる
+// OnFlush() を持たない gate は何もしない
+template <size_t I, class S, class CTX, class CB, enable_if<is_composite<S>> = nullptr>
+constexpr void gate_flush(const S &stage, CTX &ctx, CB &&cb)
+{
+    stage.template OnFlushAt<I>(ctx, std::forward<CB>(cb));
+}
+
+template <size_t I, class S, class CTX, class CB, enable_if<std::integral_constant<bool, !is_composite<S>::value>, has_flush<I, S, CTX, CB>> = nullptr>
+constexpr void gate_flush(const S &stage, CTX &ctx, CB &&cb)
+{
+    stage.OnFlush(get<I>(ctx), std::forward<CB>(cb));
+}
+
+template <size_t I, class S, class CTX, class CB, enable_if<std::integral_constant<bool, !is_composite<S>::value && !has_flush<I, S, CTX, CB>::value>> = nullptr>
+constexpr void gate_flush(const S&, CTX&, CB&&)
+{ }
+
+/* ****************************************************************
+    並列実行 (par_flat_map) 用
+    ワーカーごとのコンテキストを flush して 1 つに統合する
+    - 単体の drain は OnMerge(CTX &into, CTX &&from) を実装すること
+    - 単体の drain の OnFlushAll(CTX&) は省略可 (内部に gate を持つ drain 用)
+ */
+
+template <class S, class C, class = void>
+struct has_merge: std::false_type { };
+
+template <class S, class C>
+struct has_merge<S, C, typename voider<decltype(std::declval<const rm_cvref_t<S>&>().OnMerge(std::declval<C&>(), std::declval<C>()))>::type>: std::true_type { };
+
+template <class S, class C, class = void>
+struct has_flush_all: std::false_type { };
+
+template <class S, class C>
+struct has_flush_all<S, C, typename voider<decltype(std::declval<const rm_cvref_t<S>&>().OnFlushAll(std::declval<C&>()))>::type>: std::true_type { };
+
+// drain 自身のコンテキスト単位
+template <class S, class C, enable_if<is_composite<S>> = nullptr>
+void drain_merge(const S &stage, C &into, C &&from)
+{
+    stage.template OnMergeAt<0>(into, from);
+}
+
+template <class S, class C, enable_if<std::integral_constant<bool, !is_composite<S>::value>> = nullptr>
+void drain_merge(const S &stage, C &into, C &&from)
+{
+    static_assert(has_merge<S, C>::value, "drain does not support merging per-worker contexts (OnMerge)");
+    stage.OnMerge(into, std::move(from));
+}
+
+template <class S, class C, enable_if<is_composite<S>> = nullptr>
+void drain_flush(const S &stage, C &ctx)
+{
+    stage.template OnFlushAllAt<0>(ctx);
+}
+
+template <class S, class C, enable_if<std::integral_constant<bool, !is_composite<S>::value>, has_flush_all<S, C>> = nullptr>
+void drain_flush(const S &stage, C &ctx)
+{
+    stage.OnFlushAll(ctx);
+}
+
+template <class S, class C, enable_if<std::integral_constant<bool, !is_composite<S>::value && !has_flush_all<S, C>::value>> = nullptr>
+void drain_flush(const S&, C&)
+{ }
+
+// フラットなコンテキストの I 番目から始まる drain
+template <size_t I, class S, class CTX, enable_if<is_composite<S>> = nullptr>
+void jct_merge(const S &stage, CTX &into, CTX &from)
+{
+    stage.template OnMergeAt<I>(into, from);
+}
+
+template <size_t I, class S, class CTX, enable_if<std::integral_constant<bool, !is_composite<S>::value>> = nullptr>
+void jct_merge(const S &stage, CTX &into, CTX &from)
+{
+    drain_merge(stage, get<I>(into), std::move(get<I>(from)));
+}
+
+template <size_t I, class S, class CTX, enable_if<is_composite<S>> = nullptr>
+void jct_flush(const S &stage, CTX &ctx)
+{
+    stage.template OnFlushAllAt<I>(ctx);
+}
+
+template <size_t I, class S, class CTX, enable_if<std::integral_constant<bool, !is_composite<S>::value>> = nullptr>
+void jct_flush(const S &stage, CTX &ctx)
+{
+    drain_flush(stage, get<I>(ctx));
+}
+
+/* ****************************************************************
+    インクリメンタル実行 (incremental) 用
+    終端処理せずに現在の結果を参照する
+    - 単体の drain の OnPeek(const CTX&) は省略可 (結果を const 参照で返す)
+    - 複合 drain は OnFlush() を持つ gate がなく、末端の drain が OnPeek() を持つ場合のみ
+ */
+
+template <class S, class C, class = void>
+struct has_peek: std::false_type { };
+
+template <class S, class C>
+struct has_peek<S, C, typename voider<decltype(std::declval<const rm_cvref_t<S>&>().OnPeek(std::declval<const C&>()))>::type>: std::true_type { };
+
+// フラットなコンテキストの I 番目から始まる drain
+template <size_t I, class S, class CTX, enable_if<is_composite<S>> = nullptr>
+constexpr decltype(auto) jct_peek(const S & stage, const CTX & ctx) {
+    return stage.template OnPeekAt<I>(ctx);
+}
+
+template <size_t I, class S, class CTX, enable_if<std::integral_constant<bool, !is_composite<S>::value>> = nullptr>
+constexpr decltype(auto) jct_peek(const S & stage, const CTX & ctx) {
+    return stage.OnPeek(get<I>(ctx));
+}
+
+// drain 自身のコンテキスト単位
+template <class S, class C, enable_if<is_composite<S>> = nullptr>
+constexpr decltype(auto) drain_peek(const S & stage, const C & ctx) {
+    return stage.template OnPeekAt<0>(ctx);
+}
+
+template <class S, class C, enable_if<std::integral_constant<bool, !is_composite<S>::value>> = nullptr>
+constexpr decltype(auto) drain_peek(const S & stage, const C & ctx) {
+    return stage.OnPeek(ctx);
+}
+
+// I 番目から始まるステージのコンテキストを取り出す
+template <size_t I, class S, class... C, enable_if<is_composite<S>> = nullptr>
+constexpr auto ctx_of(Context<C ...> &&ctx)
+{
+    return ctx_drop<I>(std::move(ctx));
+}
+
+template <size_t I, class S, class... C, enable_if<std::integral_constant<bool, !is_composite<S>::value>> = nullptr>
+constexpr std::tuple_element_t<I, std::tuple<C ...>> ctx_of(Context<C ...> &&ctx)
+{
+    return get<I>(std::move(ctx));
+}
+
+} // namespace impl
+
+} // namespace fet
+
+namespace std
+{
+
+template <class... C>
+struct tuple_size<fet::impl::Context<C ...>>: std::integral_constant<size_t, sizeof...(C)> { };
+
+template <size_t I, class... C>
+struct tuple_element<I, fet::impl::Context<C ...>>: tuple_element<I, tuple<C ...>> { };
+
+} // namespace std
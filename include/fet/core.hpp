@@ -1,5 +1,6 @@
 #pragma once
 
+#include "context.hpp"
 #include "util.hpp"
 
 /* ****************************************************************
@@ -57,6 +58,8 @@ class IGate
     // SourceInfo<T> GetInfo(const SourceInfo<E>&) const;
     // CTX OnConnect(const SourceInfo<E>&) const;
     // void OnNext(CTX&, E&&, callback) const;
+    // void OnFlush(CTX&, callback) const; 省略可 終端で溜めている要素を吐き出す
+    // void OnError(CTX&, Unexpected<Er>&&, callback) const; 省略可 無ければエラーは素通りする
 
 protected:
     template <class E>
@@ -71,6 +74,10 @@ class IDrain: IJunction
     // CTX OnConnect(const SourceInfo<E>&) const;
     // void OnNext(CTX&, E&&) const;
     // R OnComplete(CTX&&) const;
+    // void OnMerge(CTX &into, CTX &&from) const; 省略可 par_flat_map でワーカーごとのコンテキストを統合する
+    //     各ワーカーのコンテキストは OnConnect() の初期値から始まるので、from の初期値からの差分を into に加えること
+    // const R &OnPeek(const CTX&) const; 省略可 incremental で終端処理せずに結果を参照する
+    // void OnError(CTX&, Unexpected<Er>&&) const; 省略可 無ければエラーは捨てる
 
 protected:
     using IJunction::OnConnect;
@@ -101,6 +108,39 @@ using is_drain = is_base_of<IDrain, T ...>;
     gate   | drain => drain
  */
 
+/* ****************************************************************
+    複合ステージ内で後段へ要素を渡すコールバック
+    後段が noexcept ならコールバックも noexcept になるので
+    noexcept 指定がパイプライン全体に伝わる
+ */
+
+// I 番目から始まる junction (gate | drain) へ渡す
+template <size_t I, class J, class CTX>
+struct JctNext
+{
+    const J &jct;
+    CTX &ctx;
+
+    template <class E>
+    constexpr decltype(auto) operator ()(E && e) const noexcept(noexcept(jct_next<I>(std::declval<const J&>(), std::declval<CTX&>(), std::declval<E>()))) {
+        return jct_next<I>(jct, ctx, std::forward<E>(e));
+    }
+};
+
+// I 番目から始まる gate へ渡す (cb はその gate の後段)
+template <size_t I, class G, class CTX, class CB>
+struct GateNext
+{
+    const G &gate;
+    CTX &ctx;
+    CB &cb;
+
+    template <class E>
+    constexpr decltype(auto) operator ()(E && e) const noexcept(noexcept(gate_next<I>(std::declval<const G&>(), std::declval<CTX&>(), std::declval<E>(), std::declval<CB>()))) {
+        return gate_next<I>(gate, ctx, std::forward<E>(e), std::forward<CB>(cb));
+    }
+};
+
 template <class G, class J, enable_if<is_gate<G>, is_jct<J>> = nullptr>
 class Junction: IJunction
 {
@@ -109,6 +149,8 @@ protected:
     J m_jct;
 
 public:
+    using ctx_size = std::integral_constant<size_t, ctx_size_of<G>::value + ctx_size_of<J>::value>;
+
     constexpr Junction(G &&gate, J &&jct):
         m_gate (std::forward<G>(gate)),
         m_jct  (std::forward<J>(jct))
@@ -117,17 +159,36 @@ public:
     template <class E>
     constexpr auto OnConnect(const SourceInfo<E> &info) const
     {
-        return std::pair<decltype(m_gate.OnConnect(info)), decltype(m_jct.OnConnect(m_gate.GetInfo(info)))> {
-            m_gate.OnConnect(info), m_jct.OnConnect(m_gate.GetInfo(info))
-        };
+        auto ctx = connect_ctx(m_gate, info);
+        return ctx_cat(std::move(ctx), connect_ctx(m_jct, m_gate.GetInfo(info)));
+    }
+
+    template <size_t I, class CTX>
+    using next_t = JctNext<I + ctx_size_of<G>::value, J, CTX>;
+
+    template <size_t I, class CTX, class E>
+    constexpr auto OnNextAt(CTX &ctx, E &&e) const noexcept(noexcept(gate_next<I>(std::declval<const G&>(), ctx, std::forward<E>(e), std::declval<next_t<I, CTX>>())))
+    {
+        return gate_next<I>(m_gate, ctx, std::forward<E>(e), next_t<I, CTX> { m_jct, ctx });
     }
 
     template <class CTX, class E>
-    constexpr auto OnNext(CTX &ctx, E &&e) const
+    constexpr auto OnNext(CTX &ctx, E &&e) const noexcept(noexcept(std::declval<const Junction&>().template OnNextAt<0>(ctx, std::forward<E>(e))))
+    {
+        return OnNextAt<0>(ctx, std::forward<E>(e));
+    }
+
+    // m_gate のみ flush する (m_jct 内の gate は m_jct の持ち主が flush する)
+    template <size_t I, class CTX>
+    constexpr void OnFlushAt(CTX &ctx) const
+    {
+        gate_flush<I>(m_gate, ctx, next_t<I, CTX> { m_jct, ctx });
+    }
+
+    template <class CTX>
+    constexpr void OnFlush(CTX &ctx) const
     {
-        return m_gate.OnNext(ctx.first, std::forward<E>(e), [&](auto &&e) {
-            return m_jct.OnNext(ctx.second, std::forward<decltype(e)>(e));
-        });
+        OnFlushAt<0>(ctx);
     }
 };
 
@@ -158,12 +219,29 @@ public:
 
     template <class J, enable_if<is_jct<J>> = nullptr>
     constexpr decltype(auto) Emit(J && jct) const & {
-        return m_src.Emit(make_jct(m_gate, std::forward<J>(jct))).second;
+        auto j = make_jct(m_gate, std::forward<J>(jct));
+        auto ctx = m_src.Emit(j);
+        j.OnFlush(ctx);
+        return ctx_of<ctx_size_of<G>::value, J>(std::move(ctx));
     }
 
     template <class J, enable_if<is_jct<J>> = nullptr>
     decltype(auto) Emit(J && jct) && {
-        return std::forward<S>(m_src).Emit(make_jct(std::forward<G>(m_gate), std::forward<J>(jct))).second;
+        auto j = make_jct(std::forward<G>(m_gate), std::forward<J>(jct));
+        auto ctx = std::forward<S>(m_src).Emit(j);
+        j.OnFlush(ctx);
+        return ctx_of<ctx_size_of<G>::value, J>(std::move(ctx));
+    }
+
+    // 上流の source と gate を取り出す (パイプラインを組み替える時用)
+    constexpr S &&upstream() &&
+    {
+        return std::forward<S>(m_src);
+    }
+
+    constexpr G &&gate() &&
+    {
+        return std::forward<G>(m_gate);
     }
 };
 
@@ -180,6 +258,8 @@ class Gate: IGate
     G2 m_gate2;
 
 public:
+    using ctx_size = std::integral_constant<size_t, ctx_size_of<G1>::value + ctx_size_of<G2>::value>;
+
     constexpr Gate(G1 &&gate1, G2 &&gate2):
         m_gate1 (std::forward<G1>(gate1)),
         m_gate2 (std::forward<G2>(gate2))
@@ -194,16 +274,34 @@ public:
     template <class E>
     constexpr auto OnConnect(const SourceInfo<E> &info) const
     {
-        return std::pair<decltype(m_gate1.OnConnect(info)), decltype(m_gate2.OnConnect(m_gate1.GetInfo(info)))> {
-            m_gate1.OnConnect(info), m_gate2.OnConnect(m_gate1.GetInfo(info))
-        };
+        auto ctx = connect_ctx(m_gate1, info);
+        return ctx_cat(std::move(ctx), connect_ctx(m_gate2, m_gate1.GetInfo(info)));
+    }
+
+    template <size_t I, class CTX, class CB>
+    using next_t = GateNext<I + ctx_size_of<G1>::value, G2, CTX, CB>;
+
+    template <size_t I, class CTX, class E, class CB>
+    constexpr decltype(auto) OnNextAt(CTX & ctx, E && e, CB && cb) const noexcept(noexcept(gate_next<I>(std::declval<const G1&>(), ctx, std::forward<E>(e), std::declval<next_t<I, CTX, CB>>()))) {
+        return gate_next<I>(m_gate1, ctx, std::forward<E>(e), next_t<I, CTX, CB> { m_gate2, ctx, cb });
     }
 
     template <class CTX, class E, class CB>
-    constexpr decltype(auto) OnNext(CTX & ctx, E && e, CB && cb) const {
-        return m_gate1.OnNext(ctx.first, std::forward<E>(e), [&](auto &&e) {
-            return m_gate2.OnNext(ctx.second, std::forward<decltype(e)>(e), std::forward<CB>(cb));
-        });
+    constexpr decltype(auto) OnNext(CTX & ctx, E && e, CB && cb) const noexcept(noexcept(std::declval<const Gate&>().template OnNextAt<0>(ctx, std::forward<E>(e), std::forward<CB>(cb)))) {
+        return OnNextAt<0>(ctx, std::forward<E>(e), std::forward<CB>(cb));
+    }
+
+    template <size_t I, class CTX, class CB>
+    constexpr void OnFlushAt(CTX &ctx, CB &&cb) const
+    {
+        gate_flush<I>(m_gate1, ctx, next_t<I, CTX, CB&> { m_gate2, ctx, cb });
+        gate_flush<I + ctx_size_of<G1>::value>(m_gate2, ctx, cb);
+    }
+
+    template <class CTX, class CB>
+    constexpr void OnFlush(CTX &ctx, CB &&cb) const
+    {
+        OnFlushAt<0>(ctx, std::forward<CB>(cb));
     }
 };
 
@@ -222,17 +320,43 @@ public:
         Junction<G, D>(std::forward<G>(gate), std::forward<D>(drain))
     { }
 
+    using typename Junction<G, D>::ctx_size;
     using Junction<G, D>::OnConnect;
+    using Junction<G, D>::OnNextAt;
     using Junction<G, D>::OnNext;
 
     template <class CTX>
     constexpr decltype(auto) OnComplete(CTX && ctx) const & {
-        return this->m_jct.OnComplete(std::forward<CTX>(ctx).second);
+        this->OnFlush(ctx);
+        return this->m_jct.OnComplete(ctx_of<ctx_size_of<G>::value, D>(std::forward<CTX>(ctx)));
     }
 
     template <class CTX>
     decltype(auto) OnComplete(CTX && ctx) && {
-        return std::forward<D>(this->m_jct).OnComplete(std::forward<CTX>(ctx).second);
+        this->OnFlush(ctx);
+        return std::forward<D>(this->m_jct).OnComplete(ctx_of<ctx_size_of<G>::value, D>(std::forward<CTX>(ctx)));
+    }
+
+    // 並列実行したワーカーのコンテキストの統合 (gate のコンテキストは統合しない)
+    template <size_t I, class CTX>
+    void OnFlushAllAt(CTX &ctx) const
+    {
+        this->template OnFlushAt<I>(ctx);
+        jct_flush<I + ctx_size_of<G>::value>(this->m_jct, ctx);
+    }
+
+    // gate のコンテキストはワーカーごとに独立して統合できないので、状態を持つ gate は置けない
+    template <size_t I, class CTX>
+    void OnMergeAt(CTX &into, CTX &from) const
+    {
+        static_assert(is_stateless_slots<I, CTX, std::make_index_sequence<ctx_size_of<G>::value>>::value, "gates with state cannot run inside a drain whose per-worker contexts are merged (e.g. after par_flat_map())");
+        jct_merge<I + ctx_size_of<G>::value>(this->m_jct, into, from);
+    }
+
+    // 末端の drain の結果を参照する (gate が要素を溜めていないこと)
+    template <size_t I, class CTX>
+    constexpr decltype(auto) OnPeekAt(const CTX & ctx) const {
+        return jct_peek<I + ctx_size_of<G>::value>(this->m_jct, ctx);
     }
 };
 
@@ -242,6 +366,37 @@ constexpr Drain<G, D> make_drain(G &&gate, D &&drain)
     return { std::forward<G>(gate), std::forward<D>(drain) };
 }
 
+/* ****************************************************************
+    drain_peek() が使えるか
+    flat なコンテキスト CTX の I 番目から始まるステージについて
+    OnFlush() を持つ gate がなく、末端の drain が OnPeek() を持つか
+ */
+
+// OnFlush() の有無を調べるためのコールバック
+struct PeekProbe
+{
+    template <class E>
+    void operator ()(E&&) const;
+};
+
+template <size_t I, class G, class CTX>
+struct gate_buffers: has_flush<I, G, CTX, PeekProbe> { };
+
+template <size_t I, class G1, class G2, class CTX>
+struct gate_buffers<I, Gate<G1, G2>, CTX>: std::integral_constant<bool, gate_buffers<I, rm_cvref_t<G1>, CTX>::value || gate_buffers<I + ctx_size_of<G1>::value, rm_cvref_t<G2>, CTX>::value> { };
+
+template <size_t I, class D, class CTX>
+struct can_peek_at: has_peek<D, std::tuple_element_t<I, CTX>> { };
+
+template <size_t I, class G, class D, class CTX>
+struct can_peek_at<I, Drain<G, D>, CTX>: std::integral_constant<bool, !gate_buffers<I, rm_cvref_t<G>, CTX>::value && can_peek_at<I + ctx_size_of<G>::value, rm_cvref_t<D>, CTX>::value> { };
+
+template <class D, class C, bool = is_composite<D>::value>
+struct can_peek: can_peek_at<0, D, C> { };
+
+template <class D, class C>
+struct can_peek<D, C, false>: has_peek<D, C> { };
+
 /* ****************************************************************
     パイプ演算子オーバーロード
     source | gate  => source
@@ -32,13 +32,13 @@ public:
     }
 
     template <class E, enable_if<std::is_same<R, std::result_of_t<F(R &&, E &&)>>> = nullptr>
-    constexpr void OnNext(R &ctx, E &&e) const
+    constexpr void OnNext(R &ctx, E &&e) const noexcept(noexcept(ctx = std::declval<const F&>()(std::move(ctx), std::forward<E>(e))))
     {
         ctx = m_op(std::move(ctx), std::forward<E>(e));
     }
 
     template <class E, enable_if<std::is_same<void, std::result_of_t<F(R&, E &&)>>> = nullptr>
-    constexpr void OnNext(R &ctx, E &&e) const
+    constexpr void OnNext(R &ctx, E &&e) const noexcept(noexcept(std::declval<const F&>()(ctx, std::forward<E>(e))))
     {
         m_op(ctx, std::forward<E>(e));
     }
@@ -63,13 +63,49 @@ constexpr auto accumulate(A &&init, F &&op, R &&sel)
 }
 
 template <class I, class F>
-constexpr auto count_if(I init, F &&pred)
+class CountIfDrain: IDrain
 {
-    return accumulate(init, [fwd = std::tuple<F>(std::forward<F>(pred))](auto &count, auto &&e) {
-        if (std::get<0>(fwd)(std::forward<decltype(e)>(e))) {
-            ++count;
+    I m_init;
+    F m_pred;
+
+public:
+    constexpr CountIfDrain(I &&init, F &&pred):
+        m_init (std::forward<I>(init)),
+        m_pred (std::forward<F>(pred))
+    { }
+
+    const F &predicate() const { return m_pred; }
+
+    template <class E>
+    constexpr I OnConnect(const SourceInfo<E>&) const
+    {
+        return m_init;
+    }
+
+    template <class E>
+    constexpr void OnNext(I &ctx, E &&e) const noexcept(noexcept(std::declval<const F&>()(std::forward<E>(e))) && noexcept(++ctx))
+    {
+        if (m_pred(std::forward<E>(e))) {
+            ++ctx;
         }
-    });
+    }
+
+    // どちらも m_init から数え始めているので、from は差分だけを足す
+    void OnMerge(I &into, I &&from) const
+    {
+        into += from - m_init;
+    }
+
+    constexpr I OnComplete(I &&ctx) const
+    {
+        return std::move(ctx);
+    }
+};
+
+template <class I, class F>
+constexpr auto count_if(I init, F &&pred)
+{
+    return CountIfDrain<I, F>(std::move(init), std::forward<F>(pred));
 }
 
 template <class I = size_t, class F>
@@ -78,6 +114,74 @@ constexpr auto count_if(F &&pred)
     return count_if<I>(0, std::forward<F>(pred));
 }
 
+// 要素数
+class CountDrain: IDrain
+{
+public:
+    template <class E>
+    constexpr size_t OnConnect(const SourceInfo<E>&) const
+    {
+        return 0;
+    }
+
+    template <class E>
+    constexpr void OnNext(size_t &ctx, E&&) const noexcept
+    {
+        ++ctx;
+    }
+
+    void OnMerge(size_t &into, size_t &&from) const
+    {
+        into += from;
+    }
+
+    constexpr size_t OnComplete(size_t &&ctx) const
+    {
+        return ctx;
+    }
+};
+
+inline constexpr CountDrain count()
+{
+    return {};
+}
+
+// LINQ で言うところの Sum()
+// 結果の型は要素の型 (値初期化した値から足していく)
+class SumDrain: IDrain
+{
+public:
+    template <class E>
+    constexpr rm_cvref_t<E> OnConnect(const SourceInfo<E>&) const
+    {
+        return rm_cvref_t<E>();
+    }
+
+    template <class T, class E>
+    constexpr void OnNext(T &ctx, E &&e) const noexcept(noexcept(ctx += std::forward<E>(e)))
+    {
+        ctx += std::forward<E>(e);
+    }
+
+    // from は値初期化した値 (0) から足し始めているので、そのまま差分になる
+    template <class T>
+    void OnMerge(T &into, T &&from) const
+    {
+        into += std::move(from);
+    }
+
+    template <class T>
+    constexpr T OnComplete(T &&ctx) const
+    {
+        return std::move(ctx);
+    }
+};
+
+inline constexpr SumDrain sum()
+{
+    return {};
+}
+
 template <class B, class F, enable_if<std::is_same<B, boost::tribool>> = nullptr>
 constexpr auto all_of(F &&pred)
 {
@@ -115,7 +219,9 @@ constexpr auto any_of(F &&pred)
 } // namespace impl
 
 using impl::accumulate;
+using impl::count;
 using impl::count_if;
+using impl::sum;
 using impl::all_of;
 using impl::any_of;
 
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "../any_stage.hpp"
+#include "../core.hpp"
+
+namespace fet
+{
+
+namespace impl
+{
+
+template <class T, class R>
+class IAnyDrain: public IAny
+{
+public:
+    virtual AnyCtx OnConnect(const SourceInfo<T> &info) const = 0;
+
+    // [first, first + n) の要素は move してよい
+    virtual void OnNext(AnyCtx &ctx, T *first, size_t n) const = 0;
+
+    virtual R OnComplete(AnyCtx &&ctx) const = 0;
+};
+
+template <class T, class R, class D>
+class AnyDrainImpl: public AnyImpl<IAnyDrain<T, R>, AnyDrainImpl<T, R, D>>
+{
+    D m_drain;
+
+    using CTX = decltype(connect_ctx(std::declval<const D&>(), std::declval<const SourceInfo<T>&>()));
+
+public:
+    AnyDrainImpl(D &&drain):
+        m_drain(std::move(drain))
+    { }
+
+    AnyCtx OnConnect(const SourceInfo<T> &info) const override
+    {
+        return make_any_ctx(connect_ctx(m_drain, info));
+    }
+
+    void OnNext(AnyCtx &ctx, T *first, size_t n) const override
+    {
+        auto &c = any_ctx_cast<CTX>(ctx);
+        for (auto last = first + n; first != last; ++first) {
+            jct_next<0>(m_drain, c, std::move(*first));
+        }
+    }
+
+    R OnComplete(AnyCtx &&ctx) const override
+    {
+        return m_drain.OnComplete(ctx_of<0, D>(std::move(any_ctx_cast<CTX>(ctx))));
+    }
+};
+
+template <class T>
+struct AnyDrainContext
+{
+    AnyCtx ctx;
+    std::vector<T> buf;
+};
+
+// drain を型消去する
+// 要素は batch 個ずつ溜めてから仮想関数 1 回で元の drain に渡す
+template <class T, class R>
+class AnyDrain: IDrain
+{
+    AnyBox<IAnyDrain<T, R>> m_impl;
+    size_t m_batch;
+
+    void Flush(AnyDrainContext<T> &ctx) const
+    {
+        m_impl->OnNext(ctx.ctx, ctx.buf.data(), ctx.buf.size());
+        ctx.buf.clear();
+    }
+
+public:
+    using value_type = T;
+    using result_type = R;
+
+    template <class D, enable_if<is_drain<D>, std::integral_constant<bool, !std::is_same<rm_cvref_t<D>, AnyDrain>::value>> = nullptr>
+    AnyDrain(D &&drain, size_t batch = any_batch_size):
+        m_impl  (AnyBox<IAnyDrain<T, R>>::template make<AnyDrainImpl<T, R, rm_cvref_t<D>>>(rm_cvref_t<D>(std::forward<D>(drain)))),
+        m_batch (batch ? batch : 1)
+    { }
+
+    template <class E>
+    AnyDrainContext<T> OnConnect(const SourceInfo<E> &info) const
+    {
+        AnyDrainContext<T> ctx { m_impl->OnConnect(SourceInfo<T> { info.capacity }), { } };
+        ctx.buf.reserve(m_batch);
+        return ctx;
+    }
+
+    template <class E>
+    void OnNext(AnyDrainContext<T> &ctx, E &&e) const
+    {
+        ctx.buf.emplace_back(std::forward<E>(e));
+        if (ctx.buf.size() >= m_batch) {
+            Flush(ctx);
+        }
+    }
+
+    R OnComplete(AnyDrainContext<T> &&ctx) const
+    {
+        Flush(ctx);
+        return m_impl->OnComplete(std::move(ctx.ctx));
+    }
+};
+
+} // namespace impl
+
+template <class T, class R>
+using any_drain = impl::AnyDrain<T, R>;
+
+} // namespace fet
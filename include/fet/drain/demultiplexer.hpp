@@ -0,0 +1,153 @@
+#pragma once
+
+#include <tuple>
+
+#include "../core.hpp"
+
+namespace fet
+{
+
+namespace impl
+{
+
+template <class F, class... D>
+class DemuxDrain: IDrain
+{
+    static constexpr size_t N = sizeof...(D);
+
+    F m_key;
+    std::tuple<D ...> m_drains;
+
+    template <size_t I, class CTX, class E>
+    static void Route(const DemuxDrain &self, CTX &ctx, E &&e)
+    {
+        drain_next(std::get<I>(self.m_drains), get<I>(ctx), std::forward<E>(e));
+    }
+
+    template <class CTX, class E, size_t ... I>
+    void _OnNext(size_t key, CTX &ctx, E &&e, std::index_sequence<I ...>) const
+    {
+        using route_t = void (*)(const DemuxDrain&, CTX&, E&&);
+        static constexpr route_t routes[] = { &Route<I, CTX, E>... };
+        routes[key](*this, ctx, std::forward<E>(e));
+    }
+
+    // 要素は均等に分かれると仮定して容量を割り振る
+    template <class E, size_t ... I>
+    constexpr auto _OnConnect(const SourceInfo<E> &info, std::index_sequence<I ...>) const
+    {
+        const SourceInfo<E> part { (info.capacity + N - 1) / N };
+        return Context<decltype(std::get<I>(m_drains).OnConnect(part))...> {
+            std::get<I>(m_drains).OnConnect(part)...
+        };
+    }
+
+    template <class CTX, class E, size_t ... I>
+    void _OnError(CTX &ctx, E &&e, std::index_sequence<I ...>) const
+    {
+        using expand = int[];
+        (void)expand { 0, (drain_next(std::get<I>(m_drains), get<I>(ctx), e), 0)... };
+    }
+
+    template <class CTX, size_t ... I>
+    void _OnMerge(CTX &into, CTX &from, std::index_sequence<I ...>) const
+    {
+        using expand = int[];
+        (void)expand { 0, (drain_merge(std::get<I>(m_drains), get<I>(into), std::move(get<I>(from))), 0)... };
+    }
+
+    template <class CTX, size_t ... I>
+    void _OnFlushAll(CTX &ctx, std::index_sequence<I ...>) const
+    {
+        using expand = int[];
+        (void)expand { 0, (drain_flush(std::get<I>(m_drains), get<I>(ctx)), 0)... };
+    }
+
+    template <class CTX, class T, size_t ... I>
+    static constexpr auto _OnComplete(CTX &&ctx, T &&d, std::index_sequence<I ...>)
+    {
+        return std::make_tuple(std::get<I>(std::forward<T>(d)).OnComplete(get<I>(std::forward<CTX>(ctx)))...);
+    }
+
+public:
+    constexpr DemuxDrain(F &&key, D&& ... drains):
+        m_key    (std::forward<F>(key)),
+        m_drains (std::forward<D>(drains)...)
+    { }
+
+    template <class E>
+    constexpr auto OnConnect(const SourceInfo<E> &info) const
+    {
+        return _OnConnect(info, std::index_sequence_for<D ...>());
+    }
+
+    // key(e) 番目の drain にだけ渡す (範囲外なら捨てる)
+    template <class CTX, class E>
+    void OnNext(CTX &ctx, E &&e) const
+    {
+        const size_t key = static_cast<size_t>(m_key(static_cast<const rm_cvref_t<E>&>(e)));
+        if (key < N) {
+            _OnNext(key, ctx, std::forward<E>(e), std::index_sequence_for<D ...>());
+        }
+    }
+
+    // エラーにはキーがないのですべての drain に渡す
+    template <class CTX, class E>
+    void OnError(CTX &ctx, E &&e) const
+    {
+        _OnError(ctx, std::forward<E>(e), std::index_sequence_for<D ...>());
+    }
+
+    template <class CTX>
+    void OnMerge(CTX &into, CTX &&from) const
+    {
+        _OnMerge(into, from, std::index_sequence_for<D ...>());
+    }
+
+    template <class CTX>
+    void OnFlushAll(CTX &ctx) const
+    {
+        _OnFlushAll(ctx, std::index_sequence_for<D ...>());
+    }
+
+    template <class CTX>
+    constexpr decltype(auto) OnComplete(CTX && ctx) const & {
+        return _OnComplete(std::forward<CTX>(ctx), m_drains, std::index_sequence_for<D ...>());
+    }
+
+    template <class CTX>
+    decltype(auto) OnComplete(CTX && ctx) && {
+        return _OnComplete(std::forward<CTX>(ctx), std::move(m_drains), std::index_sequence_for<D ...>());
+    }
+};
+
+template <class F, class... D>
+constexpr size_t DemuxDrain<F, D ...>::N;
+
+// 各要素を keyFn(e) 番目の drain にだけ渡す
+// mux() と違い上流は 1 回だけ評価され、要素はそのまま (右辺値なら move で) 1 つの drain に渡る
+// keyFn は 0 ～ N - 1 を返すこと (範囲外の要素は捨てる)
+// 結果は各 drain の OnComplete() の tuple
+template <size_t N, class F, class... D, enable_if<is_drain<D ...>> = nullptr>
+constexpr DemuxDrain<F, D ...> demux(F &&keyFn, D&& ... drains)
+{
+    static_assert(N == sizeof...(D), "demux<N> requires exactly N drains");
+    return { std::forward<F>(keyFn), std::forward<D>(drains)... };
+}
+
+// pred(e) が真なら drainTrue、偽なら drainFalse に渡す
+// 結果は (drainTrue の結果, drainFalse の結果) の tuple
+template <class F, class DT, class DF, enable_if<is_drain<DT, DF>> = nullptr>
+constexpr auto partition(F &&pred, DT &&drainTrue, DF &&drainFalse)
+{
+    return demux<2>([fwd = std::tuple<F>(std::forward<F>(pred))](const auto &e) -> size_t {
+        return std::get<0>(fwd)(e) ? 0 : 1;
+    }, std::forward<DT>(drainTrue), std::forward<DF>(drainFalse));
+}
+
+} // namespace impl
+
+using impl::demux;
+using impl::partition;
+
+} // namespace fet
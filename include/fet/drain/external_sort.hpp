@@ -0,0 +1,490 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <memory>
+#include <queue>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../checkpoint.hpp"
+#include "../core.hpp"
+
+namespace fet
+{
+
+namespace impl
+{
+
+/* ****************************************************************
+    ソート済みランを書き出す一時ファイル
+    tmpdir が空なら std::tmpfile() を使う
+ */
+class SpillFile
+{
+    std::string m_path;
+    std::FILE *m_fp;
+
+    static std::string UniquePath(const std::string &dir)
+    {
+        static std::atomic<unsigned> counter { 0 };
+        static const unsigned seed = std::random_device()();
+        return dir + "/fet-spill-" + std::to_string(seed) + "-" + std::to_string(counter++);
+    }
+
+    // 共有の tmpdir で既存のファイルを上書きしないよう排他的に作る ("x")
+    // 名前が衝突したら別の名前で作り直す
+    static std::FILE *Create(const std::string &tmpdir, std::string &path)
+    {
+        if (tmpdir.empty()) {
+            return std::tmpfile();
+        }
+        for (int retry = 0; retry < 16; ++retry) {
+            path = UniquePath(tmpdir);
+            errno = 0;
+            if (auto fp = std::fopen(path.c_str(), "w+bx")) {
+                return fp;
+            }
+            if (errno != EEXIST) {
+                break;
+            }
+        }
+        path.clear();
+        return nullptr;
+    }
+
+public:
+    explicit SpillFile(const std::string &tmpdir):
+        m_fp(Create(tmpdir, m_path))
+    {
+        if (!m_fp) {
+            throw std::runtime_error("fet: cannot create spill file in '" + tmpdir + "'");
+        }
+    }
+
+    SpillFile(const SpillFile&) = delete;
+    SpillFile &operator =(const SpillFile&) = delete;
+
+    ~SpillFile()
+    {
+        std::fclose(m_fp);
+        if (!m_path.empty()) {
+            std::remove(m_path.c_str());
+        }
+    }
+
+    template <class T>
+    void Write(const T *first, size_t n)
+    {
+        if (std::fwrite(first, sizeof(T), n, m_fp) != n) {
+            throw std::runtime_error("fet: failed to write spill file");
+        }
+    }
+
+    void Rewind() const
+    {
+        if (std::fflush(m_fp) != 0) {
+            throw std::runtime_error("fet: failed to flush spill file");
+        }
+        std::rewind(m_fp);
+    }
+
+    // 読み込みエラーを終端と取り違えるとランの残りを黙って失うので例外にする
+    template <class T>
+    size_t Read(T *first, size_t n) const
+    {
+        const size_t r = std::fread(first, sizeof(T), n, m_fp);
+        if (r < n && std::ferror(m_fp)) {
+            throw std::runtime_error("fet: failed to read spill file");
+        }
+        return r;
+    }
+};
+
+/* ****************************************************************
+    ランの k-way マージを行う source
+    ランが 1 つもなければメモリ上のバッファをそのまま流す
+    メモリ使用量は各ランの読み込みバッファ合計で budget バイト以内
+ */
+template <class T, class F>
+class MergeSource: ISource
+{
+    using runs_t = std::vector<std::shared_ptr<SpillFile>>;
+
+    std::vector<T> m_mem;
+    runs_t m_runs;
+    size_t m_size;
+    size_t m_budget;
+    F m_cmp;
+
+    struct Cursor
+    {
+        const SpillFile *file;
+        std::vector<T> buf;
+        size_t pos;
+
+        bool Fill()
+        {
+            buf.resize(buf.capacity());
+            buf.resize(file->Read(buf.data(), buf.size()));
+            pos = 0;
+            return !buf.empty();
+        }
+    };
+
+public:
+    using value_type = T;
+
+    MergeSource(std::vector<T> &&mem, runs_t &&runs, size_t size, size_t budget, F cmp):
+        m_mem    (std::move(mem)),
+        m_runs   (std::move(runs)),
+        m_size   (size),
+        m_budget (budget),
+        m_cmp    (std::move(cmp))
+    { }
+
+    SourceInfo<value_type> GetInfo() const
+    {
+        return {
+            . capacity = m_size,
+        };
+    }
+
+    template <class J, enable_if<is_jct<J>> = nullptr>
+    decltype(auto) Emit(J && jct) const {
+        decltype(auto) ctx = jct.OnConnect(GetInfo());
+        for (const auto &e : m_mem) {
+            jct.OnNext(ctx, e);
+        }
+        if (m_runs.empty()) {
+            return ctx;
+        }
+
+        const size_t chunk = std::max<size_t>(1, m_budget / sizeof(T) / m_runs.size());
+        std::vector<Cursor> cursors;
+        cursors.reserve(m_runs.size());
+        for (const auto &run : m_runs) {
+            run->Rewind();
+            cursors.push_back(Cursor { run.get(), { }, 0 });
+            cursors.back().buf.reserve(chunk);
+            if (!cursors.back().Fill()) {
+                cursors.pop_back();
+            }
+        }
+
+        auto greater = [&](size_t a, size_t b) {
+            return m_cmp(cursors[b].buf[cursors[b].pos], cursors[a].buf[cursors[a].pos]);
+        };
+        std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(greater);
+        for (size_t i = 0; i < cursors.size(); ++i) {
+            heap.push(i);
+        }
+        while (!heap.empty()) {
+            const size_t i = heap.top();
+            heap.pop();
+            auto &c = cursors[i];
+            jct.OnNext(ctx, static_cast<const T&>(c.buf[c.pos]));
+            if (++c.pos < c.buf.size() || c.Fill()) {
+                heap.push(i);
+            }
+        }
+        return ctx;
+    }
+};
+
+// マージ結果を一時ファイルに書き出す junction
+template <class T>
+class SpillJunction: IJunction
+{
+    SpillFile &m_file;
+    size_t m_chunk;
+
+public:
+    SpillJunction(SpillFile &file, size_t chunk):
+        m_file  (file),
+        m_chunk (chunk)
+    { }
+
+    template <class E>
+    std::vector<T> OnConnect(const SourceInfo<E>&) const
+    {
+        std::vector<T> buf;
+        buf.reserve(m_chunk);
+        return buf;
+    }
+
+    template <class E>
+    void OnNext(std::vector<T> &buf, E &&e) const
+    {
+        buf.push_back(std::forward<E>(e));
+        if (buf.size() >= m_chunk) {
+            Flush(buf);
+        }
+    }
+
+    void Flush(std::vector<T> &buf) const
+    {
+        m_file.Write(buf.data(), buf.size());
+        buf.clear();
+    }
+};
+
+template <class T>
+struct ExternalSortContext
+{
+    std::vector<T> buf;
+    std::vector<std::shared_ptr<SpillFile>> runs;
+    size_t size = 0;
+};
+
+// 書き出したランは一時ファイルで、再起動をまたいで残らないのでチェックポイントできない
+template <class T>
+struct checkpoint_codec<ExternalSortContext<T>>
+{
+    static_assert(dependent_false<T>::value, "external_sort / external_group_by cannot be resumed: spilled runs live in temporary files");
+};
+
+template <class F>
+class ExternalSortDrain: IDrain
+{
+    // 同時にマージするランの最大数
+    // これを超える場合は多段マージしてファイル数と 1 ランあたりのバッファを確保する
+    static constexpr size_t max_fan_in = 64;
+
+    F m_cmp;
+    size_t m_budget;
+    std::string m_tmpdir;
+
+    template <class T>
+    void Spill(ExternalSortContext<T> &ctx) const
+    {
+        std::sort(ctx.buf.begin(), ctx.buf.end(), m_cmp);
+        auto run = std::make_shared<SpillFile>(m_tmpdir);
+        run->Write(ctx.buf.data(), ctx.buf.size());
+        ctx.runs.push_back(std::move(run));
+        ctx.buf.clear();
+    }
+
+    template <class T>
+    size_t Capacity() const
+    {
+        return std::max<size_t>(1, m_budget / sizeof(T));
+    }
+
+    template <class T>
+    void Compact(ExternalSortContext<T> &ctx) const
+    {
+        using runs_t = std::vector<std::shared_ptr<SpillFile>>;
+        while (ctx.runs.size() > max_fan_in) {
+            runs_t next;
+            for (auto it = ctx.runs.begin(); it != ctx.runs.end();) {
+                const auto n = std::min<size_t>(max_fan_in, ctx.runs.end() - it);
+                runs_t group(std::make_move_iterator(it), std::make_move_iterator(it + n));
+                it += n;
+                if (group.size() == 1) {
+                    next.push_back(std::move(group.front()));
+                    continue;
+                }
+                auto run = std::make_shared<SpillFile>(m_tmpdir);
+                const size_t chunk = Capacity<T>() / 2 / max_fan_in + 1;
+                SpillJunction<T> jct(*run, chunk);
+                auto buf = MergeSource<T, rm_cvref_t<F>>({ }, std::move(group), 0, m_budget / 2, m_cmp).Emit(jct);
+                jct.Flush(buf);
+                next.push_back(std::move(run));
+            }
+            ctx.runs = std::move(next);
+        }
+    }
+
+public:
+    ExternalSortDrain(F &&cmp, size_t budget, std::string tmpdir):
+        m_cmp    (std::forward<F>(cmp)),
+        m_budget (budget),
+        m_tmpdir (std::move(tmpdir))
+    { }
+
+    template <class E>
+    auto OnConnect(const SourceInfo<E> &info) const
+    {
+        static_assert(std::is_trivially_copyable<E>::value, "external_sort requires trivially copyable elements");
+        ExternalSortContext<E> ctx;
+        ctx.buf.reserve(std::min(info.capacity, Capacity<E>()));
+        return ctx;
+    }
+
+    // 容量の見込みを超えたら budget 分を一度に確保する (倍々に伸ばして budget を超えないように)
+    template <class T, class E>
+    void OnNext(ExternalSortContext<T> &ctx, E &&e) const
+    {
+        if (ctx.buf.size() == ctx.buf.capacity()) {
+            ctx.buf.reserve(Capacity<T>());
+        }
+        ctx.buf.push_back(std::forward<E>(e));
+        ++ctx.size;
+        if (ctx.buf.size() >= Capacity<T>()) {
+            Spill(ctx);
+        }
+    }
+
+    template <class T>
+    MergeSource<T, rm_cvref_t<F>> OnComplete(ExternalSortContext<T> &&ctx) const
+    {
+        if (ctx.runs.empty()) {
+            std::sort(ctx.buf.begin(), ctx.buf.end(), m_cmp);
+        } else {
+            if (!ctx.buf.empty()) {
+                Spill(ctx);
+            }
+            std::vector<T>().swap(ctx.buf);
+            Compact(ctx);
+        }
+        return { std::move(ctx.buf), std::move(ctx.runs), ctx.size, m_budget, m_cmp };
+    }
+};
+
+template <class F>
+constexpr size_t ExternalSortDrain<F>::max_fan_in;
+
+// メモリ使用量 budget バイトまでバッファし、超えたらソート済みランを tmpdir の一時ファイルに書き出す
+// 結果はランを k-way マージする source
+// tmpdir が空なら std::tmpfile() を使う
+// 要素は trivially copyable であること
+template <class F>
+ExternalSortDrain<F> external_sort(F &&cmp, size_t budget, std::string tmpdir = { })
+{
+    return { std::forward<F>(cmp), budget, std::move(tmpdir) };
+}
+
+/* ****************************************************************
+    external_group_by
+ */
+
+template <class S, class F>
+class GroupSource: ISource
+{
+    S m_src;
+    F m_key;
+
+    using E = typename S::value_type;
+    using K = rm_cvref_t<decltype(std::declval<const F&>()(std::declval<const E&>()))>;
+
+public:
+    using value_type = std::pair<K, std::vector<E>>;
+
+private:
+    // 同じキーが連続する要素を 1 グループにまとめて下流に流す
+    template <class J, class CTX>
+    class JCT: IJunction
+    {
+        J &m_jct;
+        CTX &m_ctx;
+        const F &m_key;
+
+    public:
+        JCT(J &jct, CTX &ctx, const F &key):
+            m_jct (jct),
+            m_ctx (ctx),
+            m_key (key)
+        { }
+
+        template <class T>
+        value_type OnConnect(const SourceInfo<T>&) const
+        {
+            return { };
+        }
+
+        template <class T>
+        void OnNext(value_type &group, T &&e) const
+        {
+            auto key = m_key(e);
+            if (!group.second.empty() && !(group.first == key)) {
+                m_jct.OnNext(m_ctx, std::move(group));
+                group.second.clear();
+            }
+            if (group.second.empty()) {
+                group.first = std::move(key);
+            }
+            group.second.push_back(std::forward<T>(e));
+        }
+    };
+
+public:
+    GroupSource(S &&src, F key):
+        m_src (std::move(src)),
+        m_key (std::move(key))
+    { }
+
+    SourceInfo<value_type> GetInfo() const
+    {
+        return {
+            . capacity = 0,
+        };
+    }
+
+    template <class J, enable_if<is_jct<J>> = nullptr>
+    decltype(auto) Emit(J && jct) const {
+        decltype(auto) ctx = jct.OnConnect(GetInfo());
+        auto last = m_src.Emit(JCT<rm_ref_t<J>, decltype(ctx)>(jct, ctx, m_key));
+        if (!last.second.empty()) {
+            jct.OnNext(ctx, std::move(last));
+        }
+        return ctx;
+    }
+};
+
+template <class F, class G>
+class ExternalGroupByDrain: IDrain
+{
+    ExternalSortDrain<G> m_sort;
+    F m_key;
+
+public:
+    ExternalGroupByDrain(F &&key, G &&cmp, size_t budget, std::string tmpdir):
+        m_sort (std::forward<G>(cmp), budget, std::move(tmpdir)),
+        m_key  (std::forward<F>(key))
+    { }
+
+    template <class E>
+    auto OnConnect(const SourceInfo<E> &info) const
+    {
+        return m_sort.OnConnect(info);
+    }
+
+    template <class CTX, class E>
+    void OnNext(CTX &ctx, E &&e) const
+    {
+        m_sort.OnNext(ctx, std::forward<E>(e));
+    }
+
+    template <class CTX>
+    auto OnComplete(CTX &&ctx) const
+    {
+        auto src = m_sort.OnComplete(std::forward<CTX>(ctx));
+        return GroupSource<decltype(src), rm_cvref_t<F>>(std::move(src), m_key);
+    }
+};
+
+// keySelector の値でグループ化する external_sort()
+// 結果は std::pair<key, std::vector<要素>> を流す source
+// メモリに載るのは 1 グループ分 + マージ用バッファのみ
+// 1 グループは丸ごと std::vector に載るので、要素の多いキーがあるとその分は budget に収まらない
+template <class F>
+auto external_group_by(F &&keySelector, size_t budget, std::string tmpdir = { })
+{
+    auto cmp = [key = keySelector](const auto &a, const auto &b) {
+        return key(a) < key(b);
+    };
+    return ExternalGroupByDrain<F, decltype(cmp)>(std::forward<F>(keySelector), std::move(cmp), budget, std::move(tmpdir));
+}
+
+} // namespace impl
+
+using impl::external_sort;
+using impl::external_group_by;
+
+} // namespace fet
@@ -2,10 +2,6 @@
 
 #include <tuple>
 
-#include <boost/fusion/adapted/std_tuple.hpp>
-#include <boost/fusion/include/for_each.hpp>
-
-#include "../../bind_front.hpp"
 #include "../core.hpp"
 
 namespace fet
@@ -25,52 +21,88 @@ public:
     { }
 
 private:
+    // ステートレスな drain のコンテキストは Context で消える
     template <class E, size_t ... I>
-    constexpr auto _OnConnect(const SourceInfo<E> &info, std::index_sequence<I ...> = std::make_index_sequence<sizeof...(D)>()) const
+    constexpr auto _OnConnect(const SourceInfo<E> &info, std::index_sequence<I ...>) const
     {
-        return std::make_tuple(std::get<I>(m_drains).OnConnect(info)...);
+        return Context<decltype(std::get<I>(m_drains).OnConnect(info))...> {
+            std::get<I>(m_drains).OnConnect(info)...
+        };
     }
 
 public:
     template <class E>
     constexpr auto OnConnect(const SourceInfo<E> &info) const
     {
-        return _OnConnect(info);
+        return _OnConnect(info, std::index_sequence_for<D ...>());
     }
 
 private:
     template <class CTX, class E, size_t ... I>
-    constexpr void _OnNext(CTX &ctx, E &&e, std::index_sequence<I ...> = std::make_index_sequence<sizeof...(D)>()) const
+    constexpr void _OnNext(CTX &ctx, E &&e, std::index_sequence<I ...>) const
     {
-        auto onNext = std::make_tuple(std::bind_front(std::get<I>(m_drains).OnNext, std::get<I>(ctx))...);
-        boost::fusion::for_each(std::move(onNext), [&](auto &&cb) {
-            std::forward<decltype(cb)>(cb)(e);
-        });
+        using expand = int[];
+        (void)expand { 0, (drain_next(std::get<I>(m_drains), get<I>(ctx), e), 0)... };
     }
 
 public:
     template <class CTX, class E>
     constexpr auto OnNext(CTX &ctx, E &&e) const
     {
-        return _OnNext(ctx, std::forward<E>(e));
+        return _OnNext(ctx, std::forward<E>(e), std::index_sequence_for<D ...>());
+    }
+
+    // エラーも各 drain に配る
+    template <class CTX, class E>
+    constexpr void OnError(CTX &ctx, E &&e) const
+    {
+        _OnNext(ctx, std::forward<E>(e), std::index_sequence_for<D ...>());
+    }
+
+private:
+    template <class CTX, size_t ... I>
+    void _OnMerge(CTX &into, CTX &from, std::index_sequence<I ...>) const
+    {
+        using expand = int[];
+        (void)expand { 0, (drain_merge(std::get<I>(m_drains), get<I>(into), std::move(get<I>(from))), 0)... };
+    }
+
+    template <class CTX, size_t ... I>
+    void _OnFlushAll(CTX &ctx, std::index_sequence<I ...>) const
+    {
+        using expand = int[];
+        (void)expand { 0, (drain_flush(std::get<I>(m_drains), get<I>(ctx)), 0)... };
+    }
+
+public:
+    template <class CTX>
+    void OnMerge(CTX &into, CTX &&from) const
+    {
+        _OnMerge(into, from, std::index_sequence_for<D ...>());
+    }
+
+    template <class CTX>
+    void OnFlushAll(CTX &ctx) const
+    {
+        _OnFlushAll(ctx, std::index_sequence_for<D ...>());
     }
 
 private:
     template <class CTX, class T, size_t ... I>
-    static constexpr auto _OnComplete(CTX &&ctx, T &&d, std::index_sequence<I ...> = std::make_index_sequence<sizeof...(D)>())
+    static constexpr auto _OnComplete(CTX &&ctx, T &&d, std::index_sequence<I ...>)
     {
-        return std::make_tuple(std::get<I>(std::forward<T>(d)).OnComplete(std::get<I>(std::forward<CTX>(ctx)))...);
+        return std::make_tuple(std::get<I>(std::forward<T>(d)).OnComplete(get<I>(std::forward<CTX>(ctx)))...);
     }
 
 public:
     template <class CTX>
     constexpr decltype(auto) OnComplete(CTX && ctx) const & {
-        return _OnComplete(std::forward<CTX>(ctx), m_drains);
+        return _OnComplete(std::forward<CTX>(ctx), m_drains, std::index_sequence_for<D ...>());
     }
 
     template <class CTX>
     decltype(auto) OnComplete(CTX && ctx) && {
-        return _OnComplete(std::forward<CTX>(ctx), std::move(m_drains));
+        return _OnComplete(std::forward<CTX>(ctx), std::move(m_drains), std::index_sequence_for<D ...>());
     }
 };
 
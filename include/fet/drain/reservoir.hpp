@@ -0,0 +1,124 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "../checkpoint.hpp"
+#include "../core.hpp"
+#include "../gate/sample.hpp"
+
+namespace fet
+{
+
+namespace impl
+{
+
+/* ****************************************************************
+    Reservoir sampling (Algorithm L)
+    リザーバが埋まった後は、次に置き換える要素の位置を幾何分布で引くので
+    乱数は置き換え 1 回につき 3 回だけ
+ */
+template <class T>
+struct ReservoirContext
+{
+    std::vector<T> items;
+    sample_rng rng;
+    double w = 0;
+    size_t count = 0;
+    size_t next = 0;
+};
+
+// resumable() 用 (乱数エンジンの状態も含めて保存するので、再開後も同じ要素が選ばれる)
+template <class T>
+struct checkpoint_codec<ReservoirContext<T>>
+{
+    static void save(CheckpointWriter &w, const ReservoirContext<T> &v)
+    {
+        checkpoint_put(w, v.items);
+        checkpoint_put(w, v.rng);
+        checkpoint_put(w, v.w);
+        checkpoint_put(w, v.count);
+        checkpoint_put(w, v.next);
+    }
+
+    static void load(CheckpointReader &r, ReservoirContext<T> &v)
+    {
+        checkpoint_get(r, v.items);
+        checkpoint_get(r, v.rng);
+        checkpoint_get(r, v.w);
+        checkpoint_get(r, v.count);
+        checkpoint_get(r, v.next);
+    }
+};
+
+class ReservoirDrain: IDrain
+{
+    size_t m_k;
+    uint64_t m_seed;
+
+    template <class T>
+    void Skip(ReservoirContext<T> &ctx) const
+    {
+        ctx.w *= std::exp(std::log(sample_uniform(ctx.rng)) / m_k);
+        const size_t skip = sample_skip(ctx.rng, ctx.w);
+        ctx.next = skip < std::numeric_limits<size_t>::max() - ctx.next ? ctx.next + skip + 1 : std::numeric_limits<size_t>::max();
+    }
+
+public:
+    constexpr ReservoirDrain(size_t k, uint64_t seed):
+        m_k    (k),
+        m_seed (seed)
+    { }
+
+    template <class E>
+    ReservoirContext<rm_cvref_t<E>> OnConnect(const SourceInfo<E> &info) const
+    {
+        ReservoirContext<rm_cvref_t<E>> ctx;
+        ctx.items.reserve(std::min(m_k, info.capacity));
+        ctx.rng.seed(m_seed);
+        ctx.w = 1;
+        ctx.next = m_k ? 0 : std::numeric_limits<size_t>::max();
+        return ctx;
+    }
+
+    template <class T, class E>
+    void OnNext(ReservoirContext<T> &ctx, E &&e) const
+    {
+        const size_t i = ctx.count++;
+        if (i < m_k) {
+            ctx.items.push_back(std::forward<E>(e));
+            if (ctx.count == m_k) {
+                ctx.next = i;
+                Skip(ctx);
+            }
+            return;
+        }
+        if (i == ctx.next) {
+            ctx.items[std::uniform_int_distribution<size_t>(0, m_k - 1)(ctx.rng)] = std::forward<E>(e);
+            Skip(ctx);
+        }
+    }
+
+    // 選ばれた要素 (入力が k 個未満ならすべて)
+    template <class T>
+    std::vector<T> OnComplete(ReservoirContext<T> &&ctx) const
+    {
+        return std::move(ctx.items);
+    }
+};
+
+// 入力から一様に k 個を選ぶ
+// 同じ seed なら同じ要素が選ばれる (並び順は保証しない)
+inline constexpr ReservoirDrain reservoir(size_t k, uint64_t seed = default_sample_seed)
+{
+    return { k, seed };
+}
+
+} // namespace impl
+
+using impl::reservoir;
+
+} // namespace fet
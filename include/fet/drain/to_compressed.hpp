@@ -0,0 +1,126 @@
+#pragma once
+
+#include <array>
+
+#include "../checkpoint.hpp"
+#include "../compressed_ints.hpp"
+#include "../core.hpp"
+
+namespace fet
+{
+
+namespace impl
+{
+
+template <class T>
+struct CompressedContext
+{
+    CompressedInts<T> ints;
+    std::array<T, CompressedInts<T>::block_size> buf;
+    size_t n = 0;
+};
+
+// resumable() 用
+// ブロックごとに展開した値を保存し、読み込み時に append_block() で同じブロックを作り直す
+template <class T>
+struct checkpoint_codec<CompressedInts<T>>
+{
+    static void save(CheckpointWriter &w, const CompressedInts<T> &v)
+    {
+        std::array<T, CompressedInts<T>::block_size> buf;
+        checkpoint_put(w, v.block_count());
+        for (size_t i = 0; i < v.block_count(); ++i) {
+            const size_t n = v.decode_block(i, buf.data());
+            checkpoint_put(w, n);
+            for (size_t j = 0; j < n; ++j) {
+                checkpoint_put(w, buf[j]);
+            }
+        }
+    }
+
+    static void load(CheckpointReader &r, CompressedInts<T> &v)
+    {
+        std::array<T, CompressedInts<T>::block_size> buf;
+        size_t blocks = 0;
+        checkpoint_get(r, blocks);
+        v = CompressedInts<T>();
+        for (size_t i = 0; i < blocks; ++i) {
+            size_t n = 0;
+            checkpoint_get(r, n);
+            if (n > buf.size()) {
+                throw std::runtime_error("fet: malformed checkpoint");
+            }
+            for (size_t j = 0; j < n; ++j) {
+                checkpoint_get(r, buf[j]);
+            }
+            v.append_block(buf.data(), n);
+        }
+    }
+};
+
+template <class T>
+struct checkpoint_codec<CompressedContext<T>>
+{
+    static void save(CheckpointWriter &w, const CompressedContext<T> &v)
+    {
+        checkpoint_put(w, v.ints);
+        checkpoint_put(w, v.n);
+        for (size_t i = 0; i < v.n; ++i) {
+            checkpoint_put(w, v.buf[i]);
+        }
+    }
+
+    static void load(CheckpointReader &r, CompressedContext<T> &v)
+    {
+        checkpoint_get(r, v.ints);
+        checkpoint_get(r, v.n);
+        if (v.n > v.buf.size()) {
+            throw std::runtime_error("fet: malformed checkpoint");
+        }
+        for (size_t i = 0; i < v.n; ++i) {
+            checkpoint_get(r, v.buf[i]);
+        }
+    }
+};
+
+class ToCompressedDrain: IDrain
+{
+public:
+    template <class E>
+    CompressedContext<rm_cvref_t<E>> OnConnect(const SourceInfo<E> &info) const
+    {
+        CompressedContext<rm_cvref_t<E>> ctx;
+        ctx.ints.reserve(info.capacity);
+        return ctx;
+    }
+
+    template <class T, class E>
+    void OnNext(CompressedContext<T> &ctx, E &&e) const
+    {
+        ctx.buf[ctx.n++] = e;
+        if (ctx.n == ctx.buf.size()) {
+            ctx.ints.append_block(ctx.buf.data(), ctx.n);
+            ctx.n = 0;
+        }
+    }
+
+    template <class T>
+    CompressedInts<T> OnComplete(CompressedContext<T> &&ctx) const
+    {
+        ctx.ints.append_block(ctx.buf.data(), ctx.n);
+        return std::move(ctx.ints);
+    }
+};
+
+// 整数列を delta + frame-of-reference ビットパックで圧縮して保持する
+// ソート済み (または近い値が続く) 列で効果が大きい
+inline constexpr auto to_compressed()
+{
+    return ToCompressedDrain();
+}
+
+} // namespace impl
+
+using impl::to_compressed;
+
+} // namespace fet
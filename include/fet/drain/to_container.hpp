@@ -1,5 +1,6 @@
 #pragma once
 
+#include <iterator>
 #include <vector>
 
 #include "../core.hpp"
@@ -22,12 +23,24 @@ public:
         return std::move(ctr);
     }
 
-    template <class E>
-    constexpr void OnNext(C<E> &ctx, E &&e) const
+    template <class T, class E>
+    constexpr void OnNext(C<T> &ctx, E &&e) const
     {
         ctx.push_back(std::forward<E>(e));
     }
 
+    template <class T>
+    void OnMerge(C<T> &into, C<T> &&from) const
+    {
+        into.insert(into.end(), std::make_move_iterator(from.begin()), std::make_move_iterator(from.end()));
+    }
+
+    template <class T>
+    constexpr const C<T> &OnPeek(const C<T> &ctx) const
+    {
+        return ctx;
+    }
+
     template <class E>
     constexpr auto OnComplete(C<E> &&ctx) const
     {
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../core.hpp"
+
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<string_view>)
+#include <string_view>
+#define FET_TO_FILE_HAS_STRING_VIEW 1
+#endif
+#endif
+
+namespace fet
+{
+
+namespace impl
+{
+
+// 既定の I/O バッファサイズ
+constexpr size_t file_buffer_size = 1 << 20;
+
+/* ****************************************************************
+    ダブルバッファによる非同期書き込み
+    パイプラインのスレッドが表バッファを埋めている間に
+    書き込みスレッドが裏バッファを fwrite する
+ */
+class WriteBehind
+{
+    std::FILE *m_fp;
+    std::vector<char> m_buf[2];
+    size_t m_front = 0;
+    bool m_pending = false;
+    bool m_stop = false;
+    bool m_error = false;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::thread m_thread;
+
+    void Run()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (;;) {
+            m_cv.wait(lock, [&] { return m_pending || m_stop; });
+            if (!m_pending) {
+                return;
+            }
+            auto &back = m_buf[1 - m_front];
+            lock.unlock();
+            const bool ok = std::fwrite(back.data(), 1, back.size(), m_fp) == back.size();
+            back.clear();
+            lock.lock();
+            m_error = m_error || !ok;
+            m_pending = false;
+            m_cv.notify_all();
+        }
+    }
+
+    void Submit()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [&] { return !m_pending; });
+        m_front = 1 - m_front;
+        m_pending = true;
+        m_cv.notify_all();
+    }
+
+public:
+    size_t count = 0;
+
+    WriteBehind(const std::string &path, size_t bufsize):
+        m_fp(std::fopen(path.c_str(), "wb"))
+    {
+        if (!m_fp) {
+            throw std::runtime_error("fet: cannot open '" + path + "' for writing");
+        }
+        for (auto &buf : m_buf) {
+            buf.reserve(bufsize ? bufsize : 1);
+        }
+        m_thread = std::thread([this] { Run(); });
+    }
+
+    WriteBehind(const WriteBehind&) = delete;
+    WriteBehind &operator =(const WriteBehind&) = delete;
+
+    ~WriteBehind()
+    {
+        if (m_thread.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+                m_cv.notify_all();
+            }
+            m_thread.join();
+            std::fclose(m_fp);
+        }
+    }
+
+    void Write(const void *data, size_t n)
+    {
+        auto p = static_cast<const char *>(data);
+        while (n) {
+            auto &front = m_buf[m_front];
+            const size_t k = std::min(n, front.capacity() - front.size());
+            front.insert(front.end(), p, p + k);
+            p += k;
+            n -= k;
+            if (front.size() == front.capacity()) {
+                Submit();
+            }
+        }
+    }
+
+    void Close()
+    {
+        if (!m_buf[m_front].empty()) {
+            Submit();
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+            m_cv.notify_all();
+        }
+        m_thread.join();
+        const bool ok = std::fclose(m_fp) == 0;
+        if (m_error || !ok) {
+            throw std::runtime_error("fet: failed to write file");
+        }
+    }
+};
+
+template <class T, class = void>
+struct is_byte_string: std::false_type { };
+
+template <class T>
+struct is_byte_string<T, std::enable_if_t<sizeof(*std::declval<const T&>().data()) == 1 && std::is_integral<decltype(std::declval<const T&>().size())>::value>>: std::true_type { };
+
+// 中身を指すだけの文字列 (std::string_view) は trivially copyable だがポインタを書いても意味がない
+template <class T>
+struct is_string_view: std::false_type { };
+
+#ifdef FET_TO_FILE_HAS_STRING_VIEW
+template <class Ch, class Tr>
+struct is_string_view<std::basic_string_view<Ch, Tr>>: std::true_type { };
+#endif
+
+// そのままのバイト列で書く要素
+template <class T>
+using is_raw_record = std::integral_constant<bool, std::is_trivially_copyable<T>::value && !is_string_view<T>::value>;
+
+// uint64_t の長さ + 中身で書く要素
+template <class T>
+using is_length_prefixed = std::integral_constant<bool, !is_raw_record<T>::value && is_byte_string<T>::value>;
+
+class ToFileDrain: IDrain
+{
+    std::string m_path;
+    size_t m_bufsize;
+
+public:
+    ToFileDrain(std::string path, size_t bufsize):
+        m_path    (std::move(path)),
+        m_bufsize (bufsize)
+    { }
+
+    template <class E>
+    std::unique_ptr<WriteBehind> OnConnect(const SourceInfo<E>&) const
+    {
+        static_assert(!std::is_pointer<E>::value, "to_file cannot write pointers; write the pointed-to values or strings instead");
+        static_assert(is_raw_record<E>::value || is_length_prefixed<E>::value, "to_file requires trivially copyable elements or strings");
+        return std::make_unique<WriteBehind>(m_path, m_bufsize);
+    }
+
+    template <class E, enable_if<is_raw_record<rm_cvref_t<E>>> = nullptr>
+    void OnNext(std::unique_ptr<WriteBehind> &ctx, E &&e) const
+    {
+        ctx->Write(std::addressof(e), sizeof(e));
+        ++ctx->count;
+    }
+
+    // 文字列 (std::string_view を含む) は uint64_t の長さ + 中身
+    template <class E, enable_if<is_length_prefixed<rm_cvref_t<E>>> = nullptr>
+    void OnNext(std::unique_ptr<WriteBehind> &ctx, E &&e) const
+    {
+        const uint64_t n = e.size();
+        ctx->Write(&n, sizeof(n));
+        ctx->Write(e.data(), e.size());
+        ++ctx->count;
+    }
+
+    // 書き込んだ要素数
+    size_t OnComplete(std::unique_ptr<WriteBehind> &&ctx) const
+    {
+        ctx->Close();
+        return ctx->count;
+    }
+};
+
+// 要素をバイナリで path に書き出す
+// 要素は trivially copyable (そのまま) または文字列 (長さ付き) であること
+// ポインタは書けない。std::string_view は文字列として書く
+// 書き込みは別スレッドで行われ、パイプラインの計算と I/O が重なる
+inline auto to_file(std::string path, size_t bufsize = file_buffer_size)
+{
+    return ToFileDrain(std::move(path), bufsize);
+}
+
+} // namespace impl
+
+using impl::to_file;
+
+} // namespace fet
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include "work_stealing.hpp"
+
+/* ****************************************************************
+    タスクの実行場所
+    observe_on() はここに要素のバッチを投入する
+    executor は投入された順に 1 つずつタスクを実行すること
+**************************************************************** */
+namespace fet
+{
+
+namespace impl
+{
+
+class IExecutor
+{
+public:
+    virtual ~IExecutor() = default;
+
+    virtual void Post(std::unique_ptr<IParTask> task) = 0;
+
+    // 呼び出し側のスレッドで実行できるタスクを 1 つ実行する (無ければ false)
+    virtual bool RunOne() { return false; }
+};
+
+// Post() したその場で実行する
+class InlineExecutor: public IExecutor
+{
+public:
+    void Post(std::unique_ptr<IParTask> task) override
+    {
+        task->Run(0);
+    }
+};
+
+// 呼び出し側が RunOne() / RunAll() で実行する
+class ManualExecutor: public IExecutor
+{
+    std::mutex m_mutex;
+    std::deque<std::unique_ptr<IParTask>> m_tasks;
+
+public:
+    void Post(std::unique_ptr<IParTask> task) override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push_back(std::move(task));
+    }
+
+    bool RunOne() override
+    {
+        std::unique_ptr<IParTask> task;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_tasks.empty()) {
+                return false;
+            }
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+        task->Run(0);
+        return true;
+    }
+
+    size_t RunAll()
+    {
+        size_t n = 0;
+        while (RunOne()) {
+            ++n;
+        }
+        return n;
+    }
+};
+
+// 専用のスレッド 1 本で順に実行する
+class ThreadExecutor: public IExecutor
+{
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<std::unique_ptr<IParTask>> m_tasks;
+    size_t m_limit;
+    bool m_closed = false;
+    std::thread m_thread;
+
+    void Run()
+    {
+        for (;;) {
+            std::unique_ptr<IParTask> task;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cv.wait(lock, [&] { return !m_tasks.empty() || m_closed; });
+                if (m_tasks.empty()) {
+                    return;
+                }
+                task = std::move(m_tasks.front());
+                m_tasks.pop_front();
+                m_cv.notify_all();
+            }
+            task->Run(0);
+        }
+    }
+
+public:
+    // limit: 溜まっているタスクがこれに達すると Post() は待つ
+    explicit ThreadExecutor(size_t limit = 64):
+        m_limit  (limit ? limit : 1),
+        m_thread ([this] { Run(); })
+    { }
+
+    ThreadExecutor(const ThreadExecutor&) = delete;
+    ThreadExecutor &operator =(const ThreadExecutor&) = delete;
+
+    ~ThreadExecutor()
+    {
+        Close();
+    }
+
+    void Post(std::unique_ptr<IParTask> task) override
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [&] { return m_tasks.size() < m_limit || m_closed; });
+        if (m_closed) {
+            throw std::logic_error("fet: executor is closed");
+        }
+        m_tasks.push_back(std::move(task));
+        m_cv.notify_all();
+    }
+
+    // 溜まっているタスクを実行し終えてからスレッドを止める
+    void Close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_closed) {
+                return;
+            }
+            m_closed = true;
+            m_cv.notify_all();
+        }
+        m_thread.join();
+    }
+};
+
+} // namespace impl
+
+using impl::IExecutor;
+using impl::InlineExecutor;
+using impl::ManualExecutor;
+using impl::ThreadExecutor;
+
+} // namespace fet
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "util.hpp"
+
+/* ****************************************************************
+    値またはエラー (std::expected の縮小版, C++14)
+    try_transform() の戻り値として使い、エラーは Unexpected<E> として
+    パイプラインを流れる (例外は使わない)
+**************************************************************** */
+namespace fet
+{
+
+namespace impl
+{
+
+template <class E>
+class Unexpected
+{
+    E m_error;
+
+public:
+    using error_type = E;
+
+    constexpr explicit Unexpected(E &&error) noexcept(std::is_nothrow_constructible<E, E&&>::value):
+        m_error(std::forward<E>(error))
+    { }
+
+    constexpr E &error() & noexcept { return m_error; }
+
+    constexpr const E &error() const & noexcept { return m_error; }
+
+    constexpr E &&error() && noexcept { return std::move(m_error); }
+};
+
+template <class T>
+struct is_unexpected: std::false_type { };
+
+template <class E>
+struct is_unexpected<Unexpected<E>>: std::true_type { };
+
+template <class E>
+constexpr Unexpected<std::decay_t<E>> unexpected(E &&error) noexcept(std::is_nothrow_constructible<std::decay_t<E>, E&&>::value && std::is_nothrow_move_constructible<std::decay_t<E>>::value)
+{
+    return Unexpected<std::decay_t<E>>(std::decay_t<E>(std::forward<E>(error)));
+}
+
+template <class T, class E>
+class Expected
+{
+    static_assert(!std::is_reference<T>::value && !std::is_reference<E>::value, "Expected requires object types");
+
+    union
+    {
+        T m_value;
+        E m_error;
+    };
+    bool m_has_value;
+
+    template <class X>
+    using is_nothrow_from = std::integral_constant<bool, std::is_nothrow_constructible<T, decltype((std::declval<X>().m_value))>::value && std::is_nothrow_constructible<E, decltype((std::declval<X>().m_error))>::value>;
+
+    using is_nothrow_move = std::integral_constant<bool, std::is_nothrow_move_constructible<T>::value && std::is_nothrow_move_constructible<E>::value>;
+
+    template <class X>
+    void Construct(X &&other) noexcept(is_nothrow_from<X&&>::value)
+    {
+        if (other.m_has_value) {
+            ::new (std::addressof(m_value)) T(std::forward<X>(other).m_value);
+        } else {
+            ::new (std::addressof(m_error)) E(std::forward<X>(other).m_error);
+        }
+    }
+
+    void Destroy() noexcept
+    {
+        if (m_has_value) {
+            m_value.~T();
+        } else {
+            m_error.~E();
+        }
+    }
+
+public:
+    using value_type = T;
+    using error_type = E;
+
+    template <class U = T, enable_if<std::is_constructible<T, U&&>, std::integral_constant<bool, !is_unexpected<rm_cvref_t<U>>::value && !std::is_same<rm_cvref_t<U>, Expected>::value>> = nullptr>
+    Expected(U &&value) noexcept(std::is_nothrow_constructible<T, U&&>::value):
+        m_value     (std::forward<U>(value)),
+        m_has_value (true)
+    { }
+
+    template <class G, enable_if<std::is_constructible<E, G&&>> = nullptr>
+    Expected(Unexpected<G> &&u) noexcept(std::is_nothrow_constructible<E, G&&>::value):
+        m_error     (std::move(u).error()),
+        m_has_value (false)
+    { }
+
+    template <class G, enable_if<std::is_constructible<E, const G&>> = nullptr>
+    Expected(const Unexpected<G> &u) noexcept(std::is_nothrow_constructible<E, const G&>::value):
+        m_error     (u.error()),
+        m_has_value (false)
+    { }
+
+    Expected(const Expected &other) noexcept(is_nothrow_from<const Expected&>::value):
+        m_has_value(other.m_has_value)
+    {
+        Construct(other);
+    }
+
+    Expected(Expected &&other) noexcept(is_nothrow_move::value):
+        m_has_value(other.m_has_value)
+    {
+        Construct(std::move(other));
+    }
+
+    // コピーは一時オブジェクトに作ってから移す (コピーが例外を投げても *this は壊れない)
+    Expected &operator =(const Expected &other) noexcept(is_nothrow_from<const Expected&>::value && is_nothrow_move::value)
+    {
+        if (this != &other) {
+            Expected tmp(other);
+            *this = std::move(tmp);
+        }
+        return *this;
+    }
+
+    // 破棄してから作り直すので、途中で例外が出ないよう move は noexcept であること
+    Expected &operator =(Expected &&other) noexcept(is_nothrow_move::value)
+    {
+        static_assert(is_nothrow_move::value, "Expected assignment requires nothrow move constructible T and E");
+        if (this != &other) {
+            Destroy();
+            m_has_value = other.m_has_value;
+            Construct(std::move(other));
+        }
+        return *this;
+    }
+
+    ~Expected()
+    {
+        Destroy();
+    }
+
+    bool has_value() const noexcept { return m_has_value; }
+
+    explicit operator bool() const noexcept { return m_has_value; }
+
+    // 事前条件: has_value()
+    T &value() & noexcept { return m_value; }
+
+    const T &value() const & noexcept { return m_value; }
+
+    T &&value() && noexcept { return std::move(m_value); }
+
+    T &operator *() & noexcept { return m_value; }
+
+    const T &operator *() const & noexcept { return m_value; }
+
+    T &&operator *() && noexcept { return std::move(m_value); }
+
+    T *operator ->() noexcept { return std::addressof(m_value); }
+
+    const T *operator ->() const noexcept { return std::addressof(m_value); }
+
+    // 事前条件: !has_value()
+    E &error() & noexcept { return m_error; }
+
+    const E &error() const & noexcept { return m_error; }
+
+    E &&error() && noexcept { return std::move(m_error); }
+};
+
+} // namespace impl
+
+template <class T, class E>
+using expected = impl::Expected<T, E>;
+
+using impl::unexpected;
+
+} // namespace fet
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <limits>
+#include <numeric>
+#include <tuple>
+
+#include "../core.hpp"
+
+namespace fet
+{
+
+namespace impl
+{
+
+struct AdaptiveFilterStats
+{
+    double evaluated = 0;
+    double passed = 0;
+    double timed = 0;
+    double nanos = 0;
+
+    // 1 要素あたりの期待コスト / 棄却率
+    // 小さい順に評価すると期待コストが最小になる
+    // floor: 計測できるコストの下限 (これ未満の述語は同じコストとみなし、棄却率だけで並べる)
+    // 一度も評価されていない述語 (前の述語がすべて棄却している) は後ろのままにする
+    double rank(double floor) const
+    {
+        if (evaluated == 0) {
+            return std::numeric_limits<double>::infinity();
+        }
+        const double cost = std::max(timed ? nanos / timed : 0, floor);
+        const double reject = 1 - passed / evaluated;
+        return reject > 0 ? cost / reject : std::numeric_limits<double>::infinity();
+    }
+};
+
+template <size_t N>
+struct AdaptiveFilterContext
+{
+    std::array<size_t, N> order;
+    std::array<AdaptiveFilterStats, N> stats;
+    size_t count = 0;
+};
+
+template <class... F>
+class AdaptiveFilterGate: IGate
+{
+    using clock = std::chrono::steady_clock;
+
+    static constexpr size_t N = sizeof...(F);
+
+    std::tuple<F ...> m_preds;
+    size_t m_sample;
+    size_t m_period;
+
+    template <size_t I, class E>
+    static bool Call(const std::tuple<F ...> &preds, E &e)
+    {
+        return std::get<I>(preds)(e);
+    }
+
+    template <class E, size_t... I>
+    bool Eval(size_t i, E &e, std::index_sequence<I ...>) const
+    {
+        using pred_t = bool (*)(const std::tuple<F ...>&, E&);
+        static constexpr pred_t preds[] = { &Call<I, E>... };
+        return preds[i](m_preds, e);
+    }
+
+    template <class E>
+    bool Eval(size_t i, E &e) const
+    {
+        return Eval(i, e, std::index_sequence_for<F ...>());
+    }
+
+    // 連続した now() の差の最小値 (計測自体のコストと分解能)
+    static double ClockOverhead()
+    {
+        static const double overhead = [] {
+            double m = std::numeric_limits<double>::infinity();
+            for (int i = 0; i < 64; ++i) {
+                const auto begin = clock::now();
+                const auto end = clock::now();
+                m = std::min(m, std::chrono::duration<double, std::nano>(end - begin).count());
+            }
+            return std::max(m, 1.0);
+        }();
+        return overhead;
+    }
+
+    // 通過率は普段の評価 (短絡評価のまま) で数える
+    // 標本要素では評価した述語をそれぞれ 1 回ずつ計測し、時計のコストを差し引く
+    // どちらも述語の呼び出し回数は filter() を連ねた場合と同じ
+    template <class E>
+    bool Run(AdaptiveFilterContext<N> &ctx, E &e, bool timed) const
+    {
+        for (auto i : ctx.order) {
+            auto &s = ctx.stats[i];
+            bool r;
+            if (timed) {
+                const auto begin = clock::now();
+                r = Eval(i, e);
+                const auto end = clock::now();
+                const double elapsed = std::chrono::duration<double, std::nano>(end - begin).count() - ClockOverhead();
+                s.timed += 1;
+                s.nanos += std::max(elapsed, 0.0);
+            } else {
+                r = Eval(i, e);
+            }
+            s.evaluated += 1;
+            if (!r) {
+                return false;
+            }
+            s.passed += 1;
+        }
+        return true;
+    }
+
+    void Reorder(AdaptiveFilterContext<N> &ctx) const
+    {
+        const double floor = ClockOverhead();
+        std::stable_sort(ctx.order.begin(), ctx.order.end(), [&](size_t a, size_t b) {
+            return ctx.stats[a].rank(floor) < ctx.stats[b].rank(floor);
+        });
+        // 古い統計を半減させてデータの変化に追従する
+        for (auto &s : ctx.stats) {
+            s.evaluated /= 2;
+            s.passed /= 2;
+            s.timed /= 2;
+            s.nanos /= 2;
+        }
+    }
+
+public:
+    constexpr AdaptiveFilterGate(size_t sample, size_t period, F&& ... preds):
+        m_preds  (std::forward<F>(preds)...),
+        m_sample (sample ? sample : 1),
+        m_period (period ? period : 1)
+    { }
+
+    using IGate::GetInfo;
+
+    template <class E>
+    AdaptiveFilterContext<N> OnConnect(const SourceInfo<E>&) const
+    {
+        AdaptiveFilterContext<N> ctx;
+        std::iota(ctx.order.begin(), ctx.order.end(), 0);
+        return ctx;
+    }
+
+    template <class E, class CB>
+    void OnNext(AdaptiveFilterContext<N> &ctx, E &&e, CB &&cb) const
+    {
+        const size_t n = ++ctx.count;
+        const bool pass = Run(ctx, e, n % m_sample == 0);
+        if (n % m_period == 0) {
+            Reorder(ctx);
+        }
+        if (pass) {
+            std::forward<CB>(cb)(std::forward<E>(e));
+        }
+    }
+};
+
+// filter(pred1) | filter(pred2) | ... と同じ結果を返す
+// 各述語の通過率と (標本要素での) コストを計測し、期待コストが最小になるよう評価順を定期的に並べ替える
+// 述語の呼び出し回数は同じ順の filter() の連なりと変わらない (計測のための余分な評価はしない)
+// 時計の分解能より軽い述語どうしは通過率だけで並べる
+// 注意
+// 述語は副作用を持たず、どの順で評価しても安全であること
+// (filterNull() の後でデリファレンスする様な依存関係のある述語は通常の filter() を連ねること)
+template <class... F>
+constexpr AdaptiveFilterGate<F ...> adaptive_filters(F&& ... preds)
+{
+    return { 128, 4096, std::forward<F>(preds)... };
+}
+
+// sample 個に 1 個を計測し、period 個ごとに並べ替える
+template <class... F>
+constexpr AdaptiveFilterGate<F ...> adaptive_filters_with(size_t sample, size_t period, F&& ... preds)
+{
+    return { sample, period, std::forward<F>(preds)... };
+}
+
+} // namespace impl
+
+using impl::adaptive_filters;
+using impl::adaptive_filters_with;
+
+} // namespace fet
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "../any_stage.hpp"
+#include "../core.hpp"
+
+namespace fet
+{
+
+namespace impl
+{
+
+template <class In, class Out>
+class IAnyGate: public IAny
+{
+public:
+    virtual SourceInfo<Out> GetInfo(const SourceInfo<In> &info) const = 0;
+
+    virtual AnyCtx OnConnect(const SourceInfo<In> &info) const = 0;
+
+    // [first, first + n) の要素は move してよい
+    // 出力は out に追加する
+    virtual void OnNext(AnyCtx &ctx, In *first, size_t n, std::vector<Out> &out) const = 0;
+
+    virtual void OnFlush(AnyCtx &ctx, std::vector<Out> &out) const = 0;
+};
+
+template <class In, class Out, class G>
+class AnyGateImpl: public AnyImpl<IAnyGate<In, Out>, AnyGateImpl<In, Out, G>>
+{
+    G m_gate;
+
+    using CTX = decltype(connect_ctx(std::declval<const G&>(), std::declval<const SourceInfo<In>&>()));
+
+public:
+    AnyGateImpl(G &&gate):
+        m_gate(std::move(gate))
+    { }
+
+    SourceInfo<Out> GetInfo(const SourceInfo<In> &info) const override
+    {
+        return { m_gate.GetInfo(info).capacity };
+    }
+
+    AnyCtx OnConnect(const SourceInfo<In> &info) const override
+    {
+        return make_any_ctx(connect_ctx(m_gate, info));
+    }
+
+    void OnNext(AnyCtx &ctx, In *first, size_t n, std::vector<Out> &out) const override
+    {
+        auto &c = any_ctx_cast<CTX>(ctx);
+        auto cb = [&](auto &&e) {
+            out.emplace_back(std::forward<decltype(e)>(e));
+        };
+        for (auto last = first + n; first != last; ++first) {
+            gate_next<0>(m_gate, c, std::move(*first), cb);
+        }
+    }
+
+    void OnFlush(AnyCtx &ctx, std::vector<Out> &out) const override
+    {
+        gate_flush<0>(m_gate, any_ctx_cast<CTX>(ctx), [&](auto &&e) {
+            out.emplace_back(std::forward<decltype(e)>(e));
+        });
+    }
+};
+
+template <class In, class Out>
+struct AnyGateContext
+{
+    AnyCtx ctx;
+    std::vector<In> in;
+    std::vector<Out> out;
+};
+
+// gate を型消去する
+// 入力は batch 個ずつ溜めてから仮想関数 1 回で元の gate に渡し
+// 出力もまとめて受け取ってから下流に流す
+template <class In, class Out>
+class AnyGate: IGate
+{
+    AnyBox<IAnyGate<In, Out>> m_impl;
+    size_t m_batch;
+
+    template <class CB>
+    void Emit(AnyGateContext<In, Out> &ctx, CB &&cb) const
+    {
+        for (auto &e : ctx.out) {
+            cb(std::move(e));
+        }
+        ctx.out.clear();
+    }
+
+    template <class CB>
+    void Process(AnyGateContext<In, Out> &ctx, CB &&cb) const
+    {
+        m_impl->OnNext(ctx.ctx, ctx.in.data(), ctx.in.size(), ctx.out);
+        ctx.in.clear();
+        Emit(ctx, std::forward<CB>(cb));
+    }
+
+public:
+    template <class G, enable_if<is_gate<G>, std::integral_constant<bool, !std::is_same<rm_cvref_t<G>, AnyGate>::value>> = nullptr>
+    AnyGate(G &&gate, size_t batch = any_batch_size):
+        m_impl  (AnyBox<IAnyGate<In, Out>>::template make<AnyGateImpl<In, Out, rm_cvref_t<G>>>(rm_cvref_t<G>(std::forward<G>(gate)))),
+        m_batch (batch ? batch : 1)
+    { }
+
+    template <class E>
+    SourceInfo<Out> GetInfo(const SourceInfo<E> &info) const
+    {
+        return m_impl->GetInfo({ info.capacity });
+    }
+
+    template <class E>
+    AnyGateContext<In, Out> OnConnect(const SourceInfo<E> &info) const
+    {
+        AnyGateContext<In, Out> ctx { m_impl->OnConnect({ info.capacity }), { }, { } };
+        ctx.in.reserve(m_batch);
+        ctx.out.reserve(m_batch);
+        return ctx;
+    }
+
+    template <class E, class CB>
+    void OnNext(AnyGateContext<In, Out> &ctx, E &&e, CB &&cb) const
+    {
+        ctx.in.emplace_back(std::forward<E>(e));
+        if (ctx.in.size() >= m_batch) {
+            Process(ctx, std::forward<CB>(cb));
+        }
+    }
+
+    template <class CB>
+    void OnFlush(AnyGateContext<In, Out> &ctx, CB &&cb) const
+    {
+        Process(ctx, cb);
+        m_impl->OnFlush(ctx.ctx, ctx.out);
+        Emit(ctx, cb);
+    }
+};
+
+} // namespace impl
+
+template <class In, class Out>
+using any_gate = impl::AnyGate<In, Out>;
+
+} // namespace fet
@@ -49,7 +49,7 @@ private:
     };
 
     template <class CB>
-    constexpr JCT<CB> make_jct(CB &&cb)
+    static constexpr JCT<CB> make_jct(CB &&cb)
     {
         return { std::forward<CB>(cb) };
     }
@@ -0,0 +1,352 @@
+#pragma once
+
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "../core.hpp"
+#include "../executor.hpp"
+
+namespace fet
+{
+
+namespace impl
+{
+
+/* ****************************************************************
+    executor 側で下流の drain を動かす
+    要素は batch 個ずつまとめて executor に投入し、drain のコンテキストは executor 側だけが触る
+    OnComplete() は投入したバッチがすべて終わるのを待ってから呼び出し側で結果を作る
+    途中で例外が出てコンテキストが破棄される場合も、デストラクタで実行中のバッチを待つ
+    (まだ始まっていないバッチは drain に渡さずに捨てる)
+ */
+template <class CTX, class T>
+struct ObserveOnState
+{
+    IExecutor &exec;
+    CTX ctx;
+    std::vector<T> pending;
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t inflight = 0;
+    bool cancelled = false;
+    std::exception_ptr error;
+
+    ObserveOnState(IExecutor &x, CTX &&c):
+        exec (x),
+        ctx  (std::move(c))
+    { }
+
+    ObserveOnState(const ObserveOnState&) = delete;
+    ObserveOnState &operator =(const ObserveOnState&) = delete;
+
+    ~ObserveOnState()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            cancelled = true;
+        }
+        Wait();
+    }
+
+    bool Failed()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return cancelled || error;
+    }
+
+    // executor 側で drain が例外を投げていたら呼び出し側で投げ直す
+    // (error は残すので、以降のバッチは drain に渡されない)
+    void Rethrow()
+    {
+        std::exception_ptr e;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            e = error;
+        }
+        if (e) {
+            std::rethrow_exception(e);
+        }
+    }
+
+    // 投入したバッチがすべて終わるまで待つ
+    // 呼び出し側で実行できる executor (ManualExecutor) なら自分で回す
+    void Wait()
+    {
+        for (;;) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (inflight == 0) {
+                    return;
+                }
+            }
+            if (!exec.RunOne()) {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&] { return inflight == 0; });
+                return;
+            }
+        }
+    }
+
+    void Done(std::exception_ptr e)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (e && !error) {
+            error = e;
+        }
+        --inflight;
+        cv.notify_all();
+    }
+};
+
+template <class D>
+class ObserveOnDrain: IDrain
+{
+    IExecutor &m_exec;
+    size_t m_batch;
+    D m_drain;
+
+    template <class T>
+    using ctx_t = decltype(connect_ctx(std::declval<const rm_cvref_t<D>&>(), std::declval<SourceInfo<T>>()));
+
+    template <class State, class Items>
+    class Task: public IParTask
+    {
+        const ObserveOnDrain &m_self;
+        State &m_state;
+        Items m_items;
+
+    public:
+        Task(const ObserveOnDrain &self, State &state, Items &&items):
+            m_self  (self),
+            m_state (state),
+            m_items (std::move(items))
+        { }
+
+        void Run(size_t) override
+        {
+            std::exception_ptr error;
+            if (!m_state.Failed()) {
+                try {
+                    m_self.Deliver(m_state.ctx, m_items);
+                } catch (...) {
+                    error = std::current_exception();
+                }
+            }
+            m_state.Done(error);
+        }
+    };
+
+    template <class CTX, class T>
+    void Deliver(CTX &ctx, std::vector<T> &items) const
+    {
+        for (auto &e : items) {
+            jct_next<0>(m_drain, ctx, std::move(e));
+        }
+    }
+
+    template <class CTX, class Er>
+    void Deliver(CTX &ctx, Unexpected<Er> &err) const
+    {
+        jct_next<0>(m_drain, ctx, std::move(err));
+    }
+
+    template <class State, class Items>
+    void Post(State &state, Items &&items) const
+    {
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            ++state.inflight;
+        }
+        try {
+            m_exec.Post(std::make_unique<Task<State, Items>>(*this, state, std::move(items)));
+        } catch (...) {
+            state.Done(nullptr);
+            throw;
+        }
+    }
+
+    // バッチの区切りごとに executor 側の失敗を調べ、残りの入力を読まずに止める
+    template <class State>
+    void PostPending(State &state) const
+    {
+        state.Rethrow();
+        if (state.pending.empty()) {
+            return;
+        }
+        auto items = std::move(state.pending);
+        state.pending.clear();
+        state.pending.reserve(m_batch);
+        Post(state, std::move(items));
+    }
+
+public:
+    constexpr ObserveOnDrain(IExecutor &exec, size_t batch, D &&drain):
+        m_exec  (exec),
+        m_batch (batch),
+        m_drain (std::forward<D>(drain))
+    { }
+
+    template <class E>
+    auto OnConnect(const SourceInfo<E> &info) const
+    {
+        using T = rm_cvref_t<E>;
+        auto state = std::make_unique<ObserveOnState<ctx_t<T>, T>>(m_exec, connect_ctx(m_drain, SourceInfo<T> { info.capacity }));
+        state->pending.reserve(m_batch);
+        return state;
+    }
+
+    template <class CTX, class T, class E>
+    void OnNext(std::unique_ptr<ObserveOnState<CTX, T>> &ctx, E &&e) const
+    {
+        ctx->pending.push_back(std::forward<E>(e));
+        if (ctx->pending.size() >= m_batch) {
+            PostPending(*ctx);
+        }
+    }
+
+    // エラーもそれまでの要素の後に executor 側で渡す
+    template <class CTX, class T, class Er>
+    void OnError(std::unique_ptr<ObserveOnState<CTX, T>> &ctx, Unexpected<Er> &&e) const
+    {
+        PostPending(*ctx);
+        Post(*ctx, std::move(e));
+    }
+
+    template <class CTX, class T>
+    decltype(auto) OnComplete(std::unique_ptr<ObserveOnState<CTX, T>> && ctx) const {
+        auto &state = *ctx;
+        PostPending(state);
+        state.Wait();
+        state.Rethrow();
+        return m_drain.OnComplete(ctx_of<0, D>(std::move(state.ctx)));
+    }
+};
+
+/* ****************************************************************
+    src | observe_on(exec) | gate ... の間、後段の gate を溜めておく source
+    drain が繋がった時点で upstream | observe_on(exec, gate ... | drain) に組み替える
+ */
+class ObserveOnGate: IGate
+{
+    IExecutor &m_exec;
+    size_t m_batch;
+
+public:
+    constexpr ObserveOnGate(IExecutor &exec, size_t batch):
+        m_exec  (exec),
+        m_batch (batch ? batch : 1)
+    { }
+
+    using IGate::GetInfo;
+    using IGate::OnConnect;
+
+    IExecutor &executor() const { return m_exec; }
+
+    size_t batch() const { return m_batch; }
+
+    // ここに要素が来るのは gate 同士の合成の中や左辺値のパイプラインに置かれた場合
+    // executor に切り替えられないのでコンパイルエラーにする
+    template <class CTX, class E, class CB>
+    void OnNext(CTX&, E&&, CB&&) const
+    {
+        static_assert(dependent_false<E>::value, "observe_on() must be piped as a temporary from a source and then straight on to the drain");
+    }
+};
+
+template <class S, class G>
+class ObservedSource: ISource
+{
+    S m_src;
+    ObserveOnGate m_hop;
+    G m_gate;
+
+public:
+    constexpr auto GetInfo() const
+    {
+        return m_gate.GetInfo(m_src.GetInfo());
+    }
+
+    using value_type = typename decltype(std::declval<ObservedSource<S, G>>().GetInfo())::value_type;
+
+    constexpr ObservedSource(S &&src, ObserveOnGate hop, G &&gate):
+        m_src  (std::forward<S>(src)),
+        m_hop  (hop),
+        m_gate (std::forward<G>(gate))
+    { }
+
+    // drain 以外に繋がれたり左辺値から Emit されたりすると executor に切り替えられない
+    template <class J, enable_if<is_jct<J>> = nullptr>
+    void Emit(J&&) const
+    {
+        static_assert(dependent_false<J>::value, "observe_on() must be piped as a temporary from a source and then straight on to the drain");
+    }
+
+    constexpr S &&upstream() &&
+    {
+        return std::forward<S>(m_src);
+    }
+
+    constexpr const ObserveOnGate &hop() const { return m_hop; }
+
+    constexpr G &&gate() &&
+    {
+        return std::forward<G>(m_gate);
+    }
+};
+
+template <class D, enable_if<is_drain<D>> = nullptr>
+constexpr ObserveOnDrain<D> operator |(ObserveOnGate &&gate, D &&drain)
+{
+    return { gate.executor(), gate.batch(), std::forward<D>(drain) };
+}
+
+template <class S, class D, enable_if<is_drain<D>> = nullptr>
+decltype(auto) operator |(Source<S, ObserveOnGate> && src, D && drain) {
+    auto &s = src;
+    return std::move(s).upstream() | (std::move(src).gate() | std::forward<D>(drain));
+}
+
+template <class S, class G, enable_if<is_gate<G>> = nullptr>
+constexpr ObservedSource<S, G> operator |(Source<S, ObserveOnGate> &&src, G &&gate)
+{
+    auto &s = src;
+    auto hop = std::move(s).gate();
+    return { std::move(src).upstream(), hop, std::forward<G>(gate) };
+}
+
+template <class S, class G1, class G2, enable_if<is_gate<G2>> = nullptr>
+constexpr auto operator |(ObservedSource<S, G1> &&src, G2 &&gate)
+{
+    auto &s = src;
+    auto hop = src.hop();
+    auto gates = make_gate(std::move(s).gate(), std::forward<G2>(gate));
+    return ObservedSource<S, decltype(gates)>(std::move(src).upstream(), hop, std::move(gates));
+}
+
+template <class S, class G, class D, enable_if<is_drain<D>> = nullptr>
+decltype(auto) operator |(ObservedSource<S, G> && src, D && drain) {
+    auto &s = src;
+    auto hop = src.hop();
+    return std::move(s).upstream() | (std::move(hop) | (std::move(src).gate() | std::forward<D>(drain)));
+}
+
+// 以降の gate と drain を executor 側で実行する
+// 例: from_container(events) | observe_on(worker) | buffer_time(10ms) | to_vector()
+// 要素は batch 個ずつ executor に渡す (残りは OnComplete() で渡す)
+// 結果は呼び出し側のスレッドで返る (ManualExecutor なら OnComplete() の中で呼び出し側が実行する)
+// 一時オブジェクトのまま source から drain まで繋ぐこと
+// それ以外 (gate 同士の合成の中や左辺値のパイプライン) に置くとコンパイルエラー
+template <class X, enable_if<std::is_base_of<IExecutor, X>> = nullptr>
+constexpr ObserveOnGate observe_on(X &exec, size_t batch = 256)
+{
+    return { exec, batch };
+}
+
+} // namespace impl
+
+using impl::observe_on;
+
+} // namespace fet
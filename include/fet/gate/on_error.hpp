@@ -0,0 +1,53 @@
+#pragma once
+
+#include "../core.hpp"
+
+namespace fet
+{
+
+namespace impl
+{
+
+template <class F>
+class OnErrorGate: IGate
+{
+    F m_func;
+
+public:
+    constexpr OnErrorGate(F &&func):
+        m_func(std::forward<F>(func))
+    { }
+
+    using IGate::GetInfo;
+    using IGate::OnConnect;
+
+    template <class E, class CB>
+    constexpr void OnNext(std::nullptr_t, E &&e, CB &&cb) const noexcept(noexcept(std::forward<CB>(cb)(std::forward<E>(e))))
+    {
+        std::forward<CB>(cb)(std::forward<E>(e));
+    }
+
+    // エラーは func に渡して止める
+    template <class U, class CB, enable_if<is_error_elem<U>> = nullptr>
+    constexpr void OnError(std::nullptr_t, U &&u, CB&&) const noexcept(noexcept(std::declval<const F&>()(std::forward<U>(u).error())))
+    {
+        m_func(std::forward<U>(u).error());
+    }
+};
+
+// 上流 (try_transform() 等) から流れてきたエラーを func(error) で受け取る
+// 値はそのまま下流に流す
+// 例: 件数を数える
+//     auto n = size_t(0);
+//     auto v = src | try_transform(parse) | on_error([&](auto &&) { ++n; }) | to_vector();
+template <class F>
+constexpr OnErrorGate<F> on_error(F &&func)
+{
+    return { std::forward<F>(func) };
+}
+
+} // namespace impl
+
+using impl::on_error;
+
+} // namespace fet
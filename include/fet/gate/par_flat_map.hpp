@@ -0,0 +1,356 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "../core.hpp"
+#include "../work_stealing.hpp"
+
+namespace fet
+{
+
+namespace impl
+{
+
+// 内側の source の要素をワーカーごとにまとめて受け渡す単位
+constexpr size_t par_batch_size = 256;
+
+// ワーカーごとのバッファの上限 (これ以上溜まるとパイプラインのスレッドが流すまでワーカーは待つ)
+constexpr size_t par_buffer_limit = par_batch_size * 16;
+
+template <class T>
+struct ParBuffer
+{
+    std::mutex mutex;
+    std::condition_variable drained;
+    std::vector<T> items;
+    bool closed = false;
+};
+
+/* ****************************************************************
+    gate として使う場合
+    f(e) と内側の Emit をワーカーで実行し、出てきた要素は
+    ワーカーごとのバッファを経由してパイプラインのスレッドが下流に流す
+ */
+template <class Out>
+struct ParFlatMapState
+{
+    WorkStealingPool pool;
+    std::vector<std::unique_ptr<ParBuffer<Out>>> buffers;
+    std::vector<Out> handoff;
+
+    explicit ParFlatMapState(size_t threads):
+        pool(threads)
+    {
+        for (size_t i = 0; i < pool.size(); ++i) {
+            buffers.push_back(std::make_unique<ParBuffer<Out>>());
+        }
+    }
+
+    // 下流に流されなくなったので、待っているワーカーを起こして残りの要素は捨てさせる
+    ~ParFlatMapState()
+    {
+        for (auto &buf : buffers) {
+            std::lock_guard<std::mutex> lock(buf->mutex);
+            buf->closed = true;
+            buf->drained.notify_all();
+        }
+        pool.Close();
+    }
+
+    // ワーカーが溜めた要素を下流に流す
+    template <class CB>
+    void Drain(CB &cb)
+    {
+        for (auto &buf : buffers) {
+            {
+                std::lock_guard<std::mutex> lock(buf->mutex);
+                handoff.swap(buf->items);
+                buf->drained.notify_all();
+            }
+            for (auto &e : handoff) {
+                cb(std::move(e));
+            }
+            handoff.clear();
+        }
+    }
+};
+
+template <class Out>
+class ParBufferJunction: IJunction
+{
+    ParBuffer<Out> &m_buf;
+    mutable std::vector<Out> m_local;
+
+public:
+    explicit ParBufferJunction(ParBuffer<Out> &buf):
+        m_buf(buf)
+    {
+        m_local.reserve(par_batch_size);
+    }
+
+    using IJunction::OnConnect;
+
+    template <class E>
+    void OnNext(std::nullptr_t, E &&e) const
+    {
+        m_local.push_back(std::forward<E>(e));
+        if (m_local.size() == par_batch_size) {
+            Flush();
+        }
+    }
+
+    // バッファが上限を超えていればパイプラインのスレッドが流すまで待つ
+    void Flush() const
+    {
+        std::unique_lock<std::mutex> lock(m_buf.mutex);
+        m_buf.drained.wait(lock, [&] { return m_buf.items.size() < par_buffer_limit || m_buf.closed; });
+        if (m_buf.closed) {
+            m_local.clear();
+            return;
+        }
+        m_buf.items.insert(m_buf.items.end(), std::make_move_iterator(m_local.begin()), std::make_move_iterator(m_local.end()));
+        m_local.clear();
+    }
+};
+
+template <class F>
+class ParFlatMapGate: IGate
+{
+    F m_func;
+    size_t m_threads;
+
+    template <class T>
+    using inner_t = rm_cvref_t<decltype(std::declval<const F&>()(std::declval<T>()))>;
+
+    template <class T, class Out>
+    class Task: public IParTask
+    {
+        const F &m_func;
+        ParFlatMapState<Out> &m_state;
+        T m_elem;
+
+    public:
+        Task(const F &func, ParFlatMapState<Out> &state, T &&elem):
+            m_func  (func),
+            m_state (state),
+            m_elem  (std::move(elem))
+        { }
+
+        void Run(size_t worker) override
+        {
+            ParBufferJunction<Out> jct(*m_state.buffers[worker]);
+            m_func(std::move(m_elem)).Emit(jct);
+            jct.Flush();
+        }
+    };
+
+public:
+    constexpr ParFlatMapGate(F &&func, size_t threads):
+        m_func    (std::forward<F>(func)),
+        m_threads (threads)
+    { }
+
+    const F &func() const & { return m_func; }
+
+    F &&func() && { return std::forward<F>(m_func); }
+
+    size_t threads() const { return m_threads; }
+
+    template <class T>
+    constexpr auto GetInfo(const SourceInfo<T>&) const
+    {
+        return SourceInfo<typename inner_t<T>::value_type> {
+            . capacity = 0,
+        };
+    }
+
+    template <class E>
+    auto OnConnect(const SourceInfo<E>&) const
+    {
+        return std::make_unique<ParFlatMapState<typename inner_t<E>::value_type>>(m_threads);
+    }
+
+    template <class Out, class E, class CB>
+    void OnNext(std::unique_ptr<ParFlatMapState<Out>> &ctx, E &&e, CB &&cb) const
+    {
+        using T = rm_cvref_t<E>;
+        while (!ctx->pool.WaitAvailable(std::chrono::milliseconds(1))) {
+            ctx->Drain(cb);
+        }
+        ctx->Drain(cb);
+        ctx->pool.Submit(std::make_unique<Task<T, Out>>(m_func, *ctx, T(std::forward<E>(e))));
+    }
+
+    template <class Out, class CB>
+    void OnFlush(std::unique_ptr<ParFlatMapState<Out>> &ctx, CB &&cb) const
+    {
+        while (!ctx->pool.WaitIdle(std::chrono::milliseconds(1))) {
+            ctx->Drain(cb);
+        }
+        ctx->pool.Close();
+        ctx->pool.Rethrow();
+        ctx->Drain(cb);
+    }
+};
+
+/* ****************************************************************
+    drain の直前に置いた場合
+    ワーカーごとに下流の drain のコンテキストを持ち、内側の要素は直接そこに流す
+    OnComplete() で各ワーカーのコンテキストを OnMerge() で統合する
+    どのワーカーのコンテキストも OnConnect() の初期値から始まるので、統合は初期値からの差分を足し込む操作
+ */
+template <class CTX>
+struct ParDrainState
+{
+    WorkStealingPool pool;
+    std::vector<CTX> ctxs;
+
+    template <class C>
+    ParDrainState(size_t threads, C &&connect):
+        pool(threads)
+    {
+        ctxs.reserve(pool.size());
+        for (size_t i = 0; i < pool.size(); ++i) {
+            ctxs.push_back(connect());
+        }
+    }
+
+    ~ParDrainState()
+    {
+        pool.Close();
+    }
+};
+
+template <class D, class CTX>
+class ParWorkerJunction: IJunction
+{
+    const D &m_drain;
+    CTX &m_ctx;
+
+public:
+    ParWorkerJunction(const D &drain, CTX &ctx):
+        m_drain (drain),
+        m_ctx   (ctx)
+    { }
+
+    using IJunction::OnConnect;
+
+    template <class E>
+    void OnNext(std::nullptr_t, E &&e) const
+    {
+        jct_next<0>(m_drain, m_ctx, std::forward<E>(e));
+    }
+};
+
+template <class F, class D>
+class ParFlatMapDrain: IDrain
+{
+    F m_func;
+    D m_drain;
+    size_t m_threads;
+
+    template <class T>
+    using inner_t = rm_cvref_t<decltype(std::declval<const F&>()(std::declval<T>()))>;
+
+    template <class T>
+    using info_t = SourceInfo<typename inner_t<T>::value_type>;
+
+    template <class T>
+    using ctx_t = decltype(connect_ctx(std::declval<const rm_cvref_t<D>&>(), std::declval<info_t<T>>()));
+
+    template <class T, class CTX>
+    class Task: public IParTask
+    {
+        const ParFlatMapDrain &m_self;
+        ParDrainState<CTX> &m_state;
+        T m_elem;
+
+    public:
+        Task(const ParFlatMapDrain &self, ParDrainState<CTX> &state, T &&elem):
+            m_self  (self),
+            m_state (state),
+            m_elem  (std::move(elem))
+        { }
+
+        void Run(size_t worker) override
+        {
+            ParWorkerJunction<rm_cvref_t<D>, CTX> jct(m_self.m_drain, m_state.ctxs[worker]);
+            m_self.m_func(std::move(m_elem)).Emit(jct);
+        }
+    };
+
+public:
+    constexpr ParFlatMapDrain(F &&func, D &&drain, size_t threads):
+        m_func    (std::forward<F>(func)),
+        m_drain   (std::forward<D>(drain)),
+        m_threads (threads)
+    { }
+
+    template <class E>
+    auto OnConnect(const SourceInfo<E>&) const
+    {
+        using CTX = ctx_t<E>;
+        return std::make_unique<ParDrainState<CTX>>(m_threads, [&] { return connect_ctx(m_drain, info_t<E> { 0 }); });
+    }
+
+    template <class CTX, class E>
+    void OnNext(std::unique_ptr<ParDrainState<CTX>> &ctx, E &&e) const
+    {
+        using T = rm_cvref_t<E>;
+        ctx->pool.Submit(std::make_unique<Task<T, CTX>>(*this, *ctx, T(std::forward<E>(e))));
+    }
+
+    template <class CTX>
+    decltype(auto) OnComplete(std::unique_ptr<ParDrainState<CTX>> && ctx) const {
+        ctx->pool.Close();
+        ctx->pool.Rethrow();
+        auto &ctxs = ctx->ctxs;
+        for (auto &c : ctxs) {
+            jct_flush<0>(m_drain, c);
+        }
+        for (size_t i = 1; i < ctxs.size(); ++i) {
+            jct_merge<0>(m_drain, ctxs[0], ctxs[i]);
+        }
+        return m_drain.OnComplete(ctx_of<0, D>(std::move(ctxs[0])));
+    }
+};
+
+template <class F, class D, enable_if<is_drain<D>> = nullptr>
+constexpr ParFlatMapDrain<F, D> operator |(ParFlatMapGate<F> &&gate, D &&drain)
+{
+    const size_t threads = gate.threads();
+    return { std::move(gate).func(), std::forward<D>(drain), threads };
+}
+
+template <class S, class F, class D, enable_if<is_drain<D>> = nullptr>
+decltype(auto) operator |(Source<S, ParFlatMapGate<F>> && src, D && drain) {
+    auto &s = src;
+    return std::move(s).upstream() | (std::move(src).gate() | std::forward<D>(drain));
+}
+
+// flat_map() の並列版
+// f(e) と内側の source の Emit をワーカースレッドで実行する (内側の source ごとに 1 タスク)
+// タスクはワーカーごとの deque に積まれ、手の空いたワーカーが他から盗む
+// - drain の直前 (src | par_flat_map(f) | drain) ではワーカーごとに drain のコンテキストを持ち
+//   最後に OnMerge() で統合する (to_vector, sum, count, count_if, mux が対応)
+// - それ以外の位置では内側の要素をパイプラインのスレッドが下流に流す
+//   ワーカーごとに par_buffer_limit 個程度まで溜まるとワーカーは待つ (大きな内側の source でもメモリは有界)
+// - drain の直前に置いた複合 drain 内の gate はワーカーごとに複製されるので、状態を持つ gate は置けない
+// 要素の順序は保証しない。後段の gate は内側の source に含めると並列に実行される
+// 要素はタスクに値で保持される (左辺値はコピー)
+// threads: ワーカー数 (0 ならハードウェアスレッド数)
+template <class F>
+constexpr ParFlatMapGate<F> par_flat_map(F &&func, size_t threads = 0)
+{
+    return { std::forward<F>(func), threads };
+}
+
+} // namespace impl
+
+using impl::par_flat_map;
+
+} // namespace fet
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <xmmintrin.h>
+#endif
+
+#include "../core.hpp"
+#include "../source/container_source.hpp"
+
+namespace fet
+{
+
+namespace impl
+{
+
+// 読み込み用のソフトウェアプリフェッチ (対応しないコンパイラでは何もしない)
+inline void prefetch_read(const void *p)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(p, 0, 3);
+#elif defined(_MSC_VER)
+    _mm_prefetch(static_cast<const char *>(p), _MM_HINT_T0);
+#else
+    (void)p;
+#endif
+}
+
+/* ****************************************************************
+    distance 個先読みしてプリフェッチするゲート
+    要素は distance 個のリングバッファを通るので順序は保たれる
+ */
+template <class T>
+struct PrefetchContext
+{
+    std::vector<T> ring;
+    size_t head = 0;
+};
+
+template <class F>
+class PrefetchGate: IGate
+{
+    F m_addr;
+    size_t m_distance;
+
+public:
+    constexpr PrefetchGate(F &&addrSel, size_t distance):
+        m_addr     (std::forward<F>(addrSel)),
+        m_distance (distance ? distance : 1)
+    { }
+
+    const F &address_selector() const { return m_addr; }
+
+    size_t distance() const { return m_distance; }
+
+    template <class E>
+    constexpr auto GetInfo(const SourceInfo<E> &info) const
+    {
+        return SourceInfo<rm_cvref_t<E>> {
+            . capacity = info.capacity,
+        };
+    }
+
+    template <class E>
+    PrefetchContext<rm_cvref_t<E>> OnConnect(const SourceInfo<E>&) const
+    {
+        PrefetchContext<rm_cvref_t<E>> ctx;
+        ctx.ring.reserve(m_distance);
+        return ctx;
+    }
+
+    template <class T, class E, class CB>
+    void OnNext(PrefetchContext<T> &ctx, E &&e, CB &&cb) const
+    {
+        prefetch_read(m_addr(static_cast<const T&>(e)));
+        if (ctx.ring.size() < m_distance) {
+            ctx.ring.push_back(std::forward<E>(e));
+            return;
+        }
+        auto &slot = ctx.ring[ctx.head];
+        std::forward<CB>(cb)(std::move(slot));
+        slot = std::forward<E>(e);
+        ctx.head = (ctx.head + 1) % m_distance;
+    }
+
+    template <class T, class CB>
+    void OnFlush(PrefetchContext<T> &ctx, CB &&cb) const
+    {
+        const size_t n = ctx.ring.size();
+        for (size_t i = 0; i < n; ++i) {
+            cb(std::move(ctx.ring[(ctx.head + i) % n]));
+        }
+        ctx.ring.clear();
+        ctx.head = 0;
+    }
+};
+
+/* ****************************************************************
+    ランダムアクセス可能なコンテナの source に直結した場合
+    バッファを使わず、source の distance 個先の要素から直接プリフェッチする
+ */
+template <class C, class F>
+class PrefetchedContainerSource: ISource
+{
+    C m_ctr;
+    PrefetchGate<F> m_gate;
+
+    template <class J, class CTR>
+    static decltype(auto) _Emit(J &jct, CTR &&ctr, const PrefetchGate<F> &gate) {
+        using elem_t = std::conditional_t<std::is_lvalue_reference<CTR>::value, decltype(*std::begin(ctr)), decltype(std::move(*std::begin(ctr)))>;
+        const size_t n = ctr.size();
+        decltype(auto) ctx = jct.OnConnect(SourceInfo<value_type> { n });
+        const auto first = std::begin(ctr);
+        const auto &addr = gate.address_selector();
+        const size_t d = std::min(gate.distance(), n);
+        for (size_t i = 0; i < d; ++i) {
+            prefetch_read(addr(static_cast<const value_type&>(first[i])));
+        }
+        for (size_t i = 0; i < n; ++i) {
+            if (i + d < n) {
+                prefetch_read(addr(static_cast<const value_type&>(first[i + d])));
+            }
+            jct.OnNext(ctx, static_cast<elem_t>(first[i]));
+        }
+        return ctx;
+    }
+
+public:
+    using value_type = typename rm_cvref_t<C>::value_type;
+
+    constexpr PrefetchedContainerSource(C &&ctr, PrefetchGate<F> &&gate):
+        m_ctr  (std::forward<C>(ctr)),
+        m_gate (std::move(gate))
+    { }
+
+    constexpr SourceInfo<value_type> GetInfo() const
+    {
+        return {
+            . capacity = static_cast<size_t>(m_ctr.size()),
+        };
+    }
+
+    template <class J, enable_if<is_jct<J>> = nullptr>
+    decltype(auto) Emit(J && jct) const & {
+        return _Emit(jct, m_ctr, m_gate);
+    }
+
+    template <class J, enable_if<is_jct<J>> = nullptr>
+    decltype(auto) Emit(J && jct) && {
+        return _Emit(jct, std::forward<C>(m_ctr), m_gate);
+    }
+};
+
+template <class C, class F, enable_if<is_random_access_ctr<C>> = nullptr>
+constexpr PrefetchedContainerSource<C, F> operator |(ContainerSource<C> &&src, PrefetchGate<F> &&gate)
+{
+    return { std::move(src).container(), std::move(gate) };
+}
+
+// addrSel(e) が返すアドレスを distance 個前の要素の時点でプリフェッチする
+// 大きなテーブルを引く transform の前に置くと DRAM のレイテンシを隠せる
+// 例: from_container(ids) | prefetch([&](int id) { return &table[id]; }, 16) | transform([&](int id) { return table[id]; })
+// 要素の順序は変わらない
+template <class F>
+constexpr PrefetchGate<F> prefetch(F &&addrSel, size_t distance = 16)
+{
+    return { std::forward<F>(addrSel), distance };
+}
+
+} // namespace impl
+
+using impl::prefetch;
+
+} // namespace fet
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <tuple>
+
+#include "../core.hpp"
+
+namespace fet
+{
+
+namespace impl
+{
+
+template <class T, size_t... I>
+using project_t = std::tuple<std::tuple_element_t<I, rm_cvref_t<T>>...>;
+
+template <size_t... I>
+class ProjectGate: IGate
+{
+public:
+    using IGate::OnConnect;
+
+    template <class T>
+    constexpr auto GetInfo(const SourceInfo<T> &info) const
+    {
+        return SourceInfo<project_t<T, I ...>> {
+            . capacity = info.capacity,
+        };
+    }
+
+    template <class E, class CB>
+    constexpr void OnNext(std::nullptr_t, E &&e, CB &&cb) const
+    {
+        std::forward<CB>(cb)(project_t<E, I ...> { std::get<I>(std::forward<E>(e))... });
+    }
+};
+
+// tuple の I... 番目の要素だけを残す
+// 要素が参照型の場合は参照のまま残る
+template <size_t... I>
+constexpr ProjectGate<I ...> project()
+{
+    return { };
+}
+
+template <class F, size_t... I>
+class FieldFilterGate: IGate
+{
+    F m_pred;
+
+public:
+    constexpr FieldFilterGate(F &&pred):
+        m_pred(std::forward<F>(pred))
+    { }
+
+    using IGate::GetInfo;
+    using IGate::OnConnect;
+
+    template <class E, class CB>
+    constexpr void OnNext(std::nullptr_t, E &&e, CB &&cb) const
+    {
+        if (m_pred(std::get<I>(e)...)) {
+            std::forward<CB>(cb)(std::forward<E>(e));
+        }
+    }
+};
+
+// tuple の I... 番目の要素だけを pred に渡す filter()
+template <size_t... I, class F>
+constexpr FieldFilterGate<F, I ...> filter_fields(F &&pred)
+{
+    return { std::forward<F>(pred) };
+}
+
+template <class F, size_t... I>
+class FieldTransformGate: IGate
+{
+    F m_func;
+
+public:
+    constexpr FieldTransformGate(F &&func):
+        m_func(std::forward<F>(func))
+    { }
+
+    using IGate::OnConnect;
+
+    template <class T>
+    constexpr auto GetInfo(const SourceInfo<T> &info) const
+    {
+        return SourceInfo<decltype(m_func(std::get<I>(std::declval<T>())...))> {
+            . capacity = info.capacity,
+        };
+    }
+
+    template <class E, class CB>
+    constexpr void OnNext(std::nullptr_t, E &&e, CB &&cb) const
+    {
+        std::forward<CB>(cb)(m_func(std::get<I>(std::forward<E>(e))...));
+    }
+
+    // source 側に project<I...>() を押し出した後の gate
+    template <size_t... J>
+    constexpr FieldTransformGate<F, J ...> rebind(std::index_sequence<J ...>) &&
+    {
+        return { std::forward<F>(m_func) };
+    }
+};
+
+// tuple の I... 番目の要素だけを func に渡す transform()
+template <size_t... I, class F>
+constexpr FieldTransformGate<F, I ...> transform_fields(F &&func)
+{
+    return { std::forward<F>(func) };
+}
+
+} // namespace impl
+
+using impl::project;
+using impl::filter_fields;
+using impl::transform_fields;
+
+} // namespace fet
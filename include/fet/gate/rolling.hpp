@@ -0,0 +1,192 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include "../core.hpp"
+
+namespace fet
+{
+
+namespace impl
+{
+
+/* ****************************************************************
+    スライディングウィンドウ集約 (two-stack)
+    front: 古い側の要素の suffix 集約 (top が最古の要素から始まる集約)
+    back : 新しい側の要素の値と、その畳み込み
+    front が空の時だけ back を畳み直すので償却 O(1)
+    結合則のみを仮定する (可換でなくてよい)
+ */
+template <class T>
+struct RollingContext
+{
+    std::vector<T> front;
+    std::vector<T> back;
+    std::vector<T> back_agg; // 0 or 1 要素 (T にデフォルトコンストラクタを要求しないため)
+};
+
+template <class F>
+class RollingGate: IGate
+{
+    size_t m_window;
+    F m_op;
+
+    template <class T>
+    void Flip(RollingContext<T> &ctx) const
+    {
+        auto &back = ctx.back;
+        for (size_t i = back.size(); i-- > 0;) {
+            if (ctx.front.empty()) {
+                ctx.front.push_back(std::move(back[i]));
+            } else {
+                ctx.front.push_back(m_op(back[i], ctx.front.back()));
+            }
+        }
+        back.clear();
+        ctx.back_agg.clear();
+    }
+
+public:
+    constexpr RollingGate(size_t window, F &&op):
+        m_window (window ? window : 1),
+        m_op     (std::forward<F>(op))
+    { }
+
+    template <class E>
+    constexpr auto GetInfo(const SourceInfo<E> &info) const
+    {
+        return SourceInfo<rm_cvref_t<E>> {
+            . capacity = info.capacity,
+        };
+    }
+
+    template <class E>
+    RollingContext<rm_cvref_t<E>> OnConnect(const SourceInfo<E>&) const
+    {
+        RollingContext<rm_cvref_t<E>> ctx;
+        ctx.front.reserve(m_window);
+        ctx.back.reserve(m_window);
+        ctx.back_agg.reserve(1);
+        return ctx;
+    }
+
+    template <class T, class E, class CB>
+    void OnNext(RollingContext<T> &ctx, E &&e, CB &&cb) const
+    {
+        if (ctx.front.size() + ctx.back.size() == m_window) {
+            if (ctx.front.empty()) {
+                Flip(ctx);
+            }
+            ctx.front.pop_back();
+        }
+        ctx.back.push_back(std::forward<E>(e));
+        if (ctx.back_agg.empty()) {
+            ctx.back_agg.push_back(ctx.back.back());
+        } else {
+            ctx.back_agg[0] = m_op(ctx.back_agg[0], ctx.back.back());
+        }
+        if (ctx.front.empty()) {
+            std::forward<CB>(cb)(T(ctx.back_agg[0]));
+        } else {
+            std::forward<CB>(cb)(T(m_op(ctx.front.back(), ctx.back_agg[0])));
+        }
+    }
+};
+
+/* ****************************************************************
+    スライディングウィンドウの最小/最大 (単調キュー)
+    ウィンドウサイズのリングバッファに (位置, 値) を単調に保持する
+ */
+template <class T>
+struct RollingExtremeContext
+{
+    std::vector<std::pair<size_t, T>> ring;
+    size_t head = 0;
+    size_t size = 0;
+    size_t count = 0;
+};
+
+template <class F>
+class RollingExtremeGate: IGate
+{
+    size_t m_window;
+    F m_cmp;
+
+public:
+    constexpr RollingExtremeGate(size_t window, F &&cmp):
+        m_window (window ? window : 1),
+        m_cmp    (std::forward<F>(cmp))
+    { }
+
+    template <class E>
+    constexpr auto GetInfo(const SourceInfo<E> &info) const
+    {
+        return SourceInfo<rm_cvref_t<E>> {
+            . capacity = info.capacity,
+        };
+    }
+
+    template <class E>
+    RollingExtremeContext<rm_cvref_t<E>> OnConnect(const SourceInfo<E>&) const
+    {
+        RollingExtremeContext<rm_cvref_t<E>> ctx;
+        ctx.ring.reserve(m_window);
+        return ctx;
+    }
+
+    template <class T, class E, class CB>
+    void OnNext(RollingExtremeContext<T> &ctx, E &&e, CB &&cb) const
+    {
+        auto &ring = ctx.ring;
+        const size_t n = ctx.count++;
+        // ウィンドウから外れた先頭を捨てる
+        if (ctx.size && ring[ctx.head].first + m_window <= n) {
+            ctx.head = (ctx.head + 1) % m_window;
+            --ctx.size;
+        }
+        // 新しい要素に負ける末尾を捨てる
+        while (ctx.size && !m_cmp(ring[(ctx.head + ctx.size - 1) % m_window].second, e)) {
+            --ctx.size;
+        }
+        const size_t tail = (ctx.head + ctx.size) % m_window;
+        if (tail < ring.size()) {
+            ring[tail].first = n;
+            ring[tail].second = std::forward<E>(e);
+        } else {
+            ring.emplace_back(n, std::forward<E>(e));
+        }
+        ++ctx.size;
+        std::forward<CB>(cb)(static_cast<const T&>(ring[ctx.head].second));
+    }
+};
+
+// 直近 window 個の要素を op で畳み込んだ値を、入力 1 要素ごとに流す
+// 先頭の window - 1 個はそれまでの要素のみで畳み込む
+// op は結合則を満たすこと (可換でなくてよい)、op(T, T) は T に変換できること
+// 例: rolling(3, std::plus<>()) は 3 要素の移動和
+template <class F>
+constexpr RollingGate<F> rolling(size_t window, F &&op)
+{
+    return { window, std::forward<F>(op) };
+}
+
+// 直近 window 個の最小値を入力 1 要素ごとに流す
+inline constexpr auto rolling_min(size_t window)
+{
+    return RollingExtremeGate<std::less<>>(window, std::less<>());
+}
+
+// 直近 window 個の最大値を入力 1 要素ごとに流す
+inline constexpr auto rolling_max(size_t window)
+{
+    return RollingExtremeGate<std::greater<>>(window, std::greater<>());
+}
+
+} // namespace impl
+
+using impl::rolling;
+using impl::rolling_min;
+using impl::rolling_max;
+
+} // namespace fet
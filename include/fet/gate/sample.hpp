@@ -0,0 +1,191 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <type_traits>
+
+#include "../checkpoint.hpp"
+#include "../core.hpp"
+#include "../source/container_source.hpp"
+
+namespace fet
+{
+
+namespace impl
+{
+
+/* ****************************************************************
+    乱数
+    標準の分布クラスは実装依存で結果が変わるので
+    mt19937_64 の出力から自前で変換し、同じ seed なら同じ結果にする
+ */
+using sample_rng = std::mt19937_64;
+
+constexpr uint64_t default_sample_seed = sample_rng::default_seed;
+
+// (0, 1) の一様乱数
+inline double sample_uniform(sample_rng &rng)
+{
+    return (static_cast<double>(rng() >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+// 確率 p の Bernoulli 試行で次に成功するまでの失敗回数 (幾何分布)
+inline size_t sample_skip(sample_rng &rng, double p)
+{
+    if (p >= 1) {
+        return 0;
+    }
+    if (p <= 0) {
+        return std::numeric_limits<size_t>::max();
+    }
+    const double k = std::floor(std::log(sample_uniform(rng)) / std::log1p(-p));
+    return k >= static_cast<double>(std::numeric_limits<size_t>::max()) ? std::numeric_limits<size_t>::max() : static_cast<size_t>(k);
+}
+
+inline size_t sample_capacity(size_t capacity, double p)
+{
+    return p >= 1 ? capacity : p <= 0 ? 0 : static_cast<size_t>(std::ceil(capacity * p));
+}
+
+struct SampleContext
+{
+    sample_rng rng;
+    size_t skip;
+};
+
+template <>
+struct checkpoint_codec<SampleContext>
+{
+    static void save(CheckpointWriter &w, const SampleContext &v)
+    {
+        checkpoint_put(w, v.rng);
+        checkpoint_put(w, v.skip);
+    }
+
+    static void load(CheckpointReader &r, SampleContext &v)
+    {
+        checkpoint_get(r, v.rng);
+        checkpoint_get(r, v.skip);
+    }
+};
+
+class SampleGate: IGate
+{
+    double m_p;
+    uint64_t m_seed;
+
+public:
+    constexpr SampleGate(double p, uint64_t seed):
+        m_p    (p),
+        m_seed (seed)
+    { }
+
+    double probability() const { return m_p; }
+
+    uint64_t seed() const { return m_seed; }
+
+    template <class E>
+    constexpr auto GetInfo(const SourceInfo<E> &info) const
+    {
+        return SourceInfo<E> {
+            . capacity = sample_capacity(info.capacity, m_p),
+        };
+    }
+
+    template <class E>
+    SampleContext OnConnect(const SourceInfo<E>&) const
+    {
+        SampleContext ctx { sample_rng(m_seed), 0 };
+        ctx.skip = sample_skip(ctx.rng, m_p);
+        return ctx;
+    }
+
+    // 乱数は残った要素 1 個につき 1 回だけ引く
+    template <class E, class CB>
+    void OnNext(SampleContext &ctx, E &&e, CB &&cb) const
+    {
+        if (ctx.skip) {
+            --ctx.skip;
+            return;
+        }
+        ctx.skip = sample_skip(ctx.rng, m_p);
+        std::forward<CB>(cb)(std::forward<E>(e));
+    }
+};
+
+/* ****************************************************************
+    ランダムアクセス可能なコンテナの source に直結した場合
+    読み飛ばす要素には触れず、添字を skip 分進める
+    (同じ seed なら SampleGate と同じ要素が選ばれる)
+ */
+template <class C>
+class SampledContainerSource: ISource
+{
+    C m_ctr;
+    SampleGate m_gate;
+
+    template <class J, class CTR>
+    static decltype(auto) _Emit(J &jct, CTR &&ctr, const SampleGate &gate) {
+        using elem_t = std::conditional_t<std::is_lvalue_reference<CTR>::value, decltype(*std::begin(ctr)), decltype(std::move(*std::begin(ctr)))>;
+        const auto info = SourceInfo<value_type> { static_cast<size_t>(ctr.size()) };
+        decltype(auto) ctx = jct.OnConnect(gate.GetInfo(info));
+        auto rng = sample_rng(gate.seed());
+        const size_t n = info.capacity;
+        auto first = std::begin(ctr);
+        for (size_t i = sample_skip(rng, gate.probability()); i < n;) {
+            jct.OnNext(ctx, static_cast<elem_t>(first[i]));
+            const size_t skip = sample_skip(rng, gate.probability());
+            if (skip >= n - i - 1) {
+                break;
+            }
+            i += skip + 1;
+        }
+        return ctx;
+    }
+
+public:
+    using value_type = typename rm_cvref_t<C>::value_type;
+
+    constexpr SampledContainerSource(C &&ctr, SampleGate gate):
+        m_ctr  (std::forward<C>(ctr)),
+        m_gate (gate)
+    { }
+
+    constexpr SourceInfo<value_type> GetInfo() const
+    {
+        return m_gate.GetInfo(SourceInfo<value_type> { m_ctr.size() });
+    }
+
+    template <class J, enable_if<is_jct<J>> = nullptr>
+    decltype(auto) Emit(J && jct) const & {
+        return _Emit(jct, m_ctr, m_gate);
+    }
+
+    template <class J, enable_if<is_jct<J>> = nullptr>
+    decltype(auto) Emit(J && jct) && {
+        return _Emit(jct, std::forward<C>(m_ctr), m_gate);
+    }
+};
+
+template <class C, enable_if<is_random_access_ctr<C>> = nullptr>
+constexpr SampledContainerSource<C> operator |(ContainerSource<C> &&src, SampleGate gate)
+{
+    return { std::move(src).container(), gate };
+}
+
+// 各要素を確率 p で残す
+// 次に残す要素までの間隔を幾何分布で引くので、乱数は残った要素 1 個につき 1 回
+// ランダムアクセス可能なコンテナの from_container() に直結すると、読み飛ばす要素に触れない
+// 同じ seed なら同じ要素が選ばれる
+inline constexpr SampleGate sample_bernoulli(double p, uint64_t seed = default_sample_seed)
+{
+    return { p, seed };
+}
+
+} // namespace impl
+
+using impl::sample_bernoulli;
+
+} // namespace fet
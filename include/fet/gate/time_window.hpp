@@ -0,0 +1,220 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+#include "../core.hpp"
+
+/* ****************************************************************
+    時間で区切るゲート
+    buffer_time(window) : window の間に来た要素を std::vector にまとめて流す
+    sample_time(period) : period ごとに最後に来た要素だけを流す
+
+    fet はタイマーを持たないので、区間が閉じるのは次の要素が来た時か終端 (OnFlush) の時
+    時計は now() を持つオブジェクトで差し替えられる (テストでは ManualClock を使う)
+**************************************************************** */
+namespace fet
+{
+
+namespace impl
+{
+
+struct SteadyClock
+{
+    using time_point = std::chrono::steady_clock::time_point;
+
+    time_point now() const
+    {
+        return std::chrono::steady_clock::now();
+    }
+};
+
+// advance() で進める時計
+// observe_on() の先でも使えるよう時刻はアトミックに持つ
+class ManualClock
+{
+    std::atomic<std::chrono::nanoseconds::rep> m_now { 0 };
+
+public:
+    using time_point = std::chrono::steady_clock::time_point;
+
+    time_point now() const
+    {
+        return time_point(std::chrono::duration_cast<time_point::duration>(std::chrono::nanoseconds(m_now.load())));
+    }
+
+    template <class R, class P>
+    void advance(const std::chrono::duration<R, P> &d)
+    {
+        m_now += std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+    }
+};
+
+template <class C>
+using clock_time_t = rm_cvref_t<decltype(std::declval<const rm_cvref_t<C>&>().now())>;
+
+template <class T, class TP>
+struct BufferTimeContext
+{
+    std::vector<T> buf;
+    TP start;
+};
+
+template <class C>
+class BufferTimeGate: IGate
+{
+    C m_clock;
+    std::chrono::nanoseconds m_window;
+    size_t m_max;
+
+    template <class T, class TP, class CB>
+    void Emit(BufferTimeContext<T, TP> &ctx, CB &cb) const
+    {
+        const size_t n = ctx.buf.size();
+        auto out = std::move(ctx.buf);
+        ctx.buf.clear();
+        ctx.buf.reserve(m_max ? m_max : n);
+        cb(std::move(out));
+    }
+
+public:
+    constexpr BufferTimeGate(C &&clock, std::chrono::nanoseconds window, size_t maxCount):
+        m_clock  (std::forward<C>(clock)),
+        m_window (window),
+        m_max    (maxCount)
+    { }
+
+    template <class E>
+    constexpr auto GetInfo(const SourceInfo<E>&) const
+    {
+        return SourceInfo<std::vector<rm_cvref_t<E>>> {
+            . capacity = 0,
+        };
+    }
+
+    template <class E>
+    auto OnConnect(const SourceInfo<E>&) const
+    {
+        BufferTimeContext<rm_cvref_t<E>, clock_time_t<C>> ctx;
+        ctx.buf.reserve(m_max);
+        return ctx;
+    }
+
+    template <class T, class TP, class E, class CB>
+    void OnNext(BufferTimeContext<T, TP> &ctx, E &&e, CB &&cb) const
+    {
+        const auto now = m_clock.now();
+        if (!ctx.buf.empty() && now - ctx.start >= m_window) {
+            Emit(ctx, cb);
+        }
+        if (ctx.buf.empty()) {
+            ctx.start = now;
+        }
+        ctx.buf.push_back(std::forward<E>(e));
+        if (ctx.buf.size() == m_max) {
+            Emit(ctx, cb);
+        }
+    }
+
+    template <class T, class TP, class CB>
+    void OnFlush(BufferTimeContext<T, TP> &ctx, CB &&cb) const
+    {
+        if (!ctx.buf.empty()) {
+            Emit(ctx, cb);
+        }
+    }
+};
+
+template <class T, class TP>
+struct SampleTimeContext
+{
+    std::vector<T> latest;   // 高々 1 要素
+    TP deadline;
+};
+
+template <class C>
+class SampleTimeGate: IGate
+{
+    C m_clock;
+    std::chrono::nanoseconds m_period;
+
+public:
+    constexpr SampleTimeGate(C &&clock, std::chrono::nanoseconds period):
+        m_clock  (std::forward<C>(clock)),
+        m_period (period.count() > 0 ? period : std::chrono::nanoseconds(1))
+    { }
+
+    template <class E>
+    constexpr auto GetInfo(const SourceInfo<E>&) const
+    {
+        return SourceInfo<rm_cvref_t<E>> {
+            . capacity = 0,
+        };
+    }
+
+    template <class E>
+    auto OnConnect(const SourceInfo<E>&) const
+    {
+        SampleTimeContext<rm_cvref_t<E>, clock_time_t<C>> ctx;
+        ctx.latest.reserve(1);
+        ctx.deadline = m_clock.now() + std::chrono::duration_cast<typename clock_time_t<C>::duration>(m_period);
+        return ctx;
+    }
+
+    template <class T, class TP, class E, class CB>
+    void OnNext(SampleTimeContext<T, TP> &ctx, E &&e, CB &&cb) const
+    {
+        const auto now = m_clock.now();
+        if (now >= ctx.deadline) {
+            if (!ctx.latest.empty()) {
+                cb(std::move(ctx.latest.front()));
+                ctx.latest.clear();
+            }
+            // 要素の来なかった区間は飛ばす
+            const auto late = std::chrono::duration_cast<std::chrono::nanoseconds>(now - ctx.deadline);
+            ctx.deadline += std::chrono::duration_cast<typename TP::duration>(m_period * (late / m_period + 1));
+        }
+        if (ctx.latest.empty()) {
+            ctx.latest.push_back(std::forward<E>(e));
+        } else {
+            ctx.latest.front() = std::forward<E>(e);
+        }
+    }
+
+    // 最後の区間の値も流す
+    template <class T, class TP, class CB>
+    void OnFlush(SampleTimeContext<T, TP> &ctx, CB &&cb) const
+    {
+        if (!ctx.latest.empty()) {
+            cb(std::move(ctx.latest.front()));
+            ctx.latest.clear();
+        }
+    }
+};
+
+// window の間に来た要素をまとめて std::vector で流す
+// 区間は最初の要素が来た時に始まる。maxCount (0 なら無制限) 個溜まった時点でも流す
+// clock を左辺値で渡すと参照で保持する
+template <class R, class P, class C = SteadyClock>
+constexpr BufferTimeGate<C> buffer_time(const std::chrono::duration<R, P> &window, size_t maxCount = 0, C &&clock = C())
+{
+    return { std::forward<C>(clock), std::chrono::duration_cast<std::chrono::nanoseconds>(window), maxCount };
+}
+
+// period ごとに最後に来た要素を流す (要素の来なかった区間は何も流さない)
+// 区間は OnConnect() の時点から数える
+template <class R, class P, class C = SteadyClock>
+constexpr SampleTimeGate<C> sample_time(const std::chrono::duration<R, P> &period, C &&clock = C())
+{
+    return { std::forward<C>(clock), std::chrono::duration_cast<std::chrono::nanoseconds>(period) };
+}
+
+} // namespace impl
+
+using impl::buffer_time;
+using impl::ManualClock;
+using impl::sample_time;
+using impl::SteadyClock;
+
+} // namespace fet
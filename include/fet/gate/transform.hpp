@@ -31,7 +31,7 @@ public:
     }
 
     template <class E, class CB>
-    constexpr void OnNext(std::nullptr_t, E &&e, CB &&cb) const
+    constexpr void OnNext(std::nullptr_t, E &&e, CB &&cb) const noexcept(noexcept(std::declval<CB>()(std::declval<const F&>()(std::forward<E>(e)))))
     {
         std::forward<CB>(cb)(m_func(std::forward<decltype(e)>(e)));
     }
@@ -44,6 +44,133 @@ constexpr TransformGate<F> transform(F &&func)
     return { std::forward<F>(func) };
 }
 
+template <class T>
+struct is_expected: std::false_type { };
+
+template <class T, class E>
+struct is_expected<Expected<T, E>>: std::true_type { };
+
+template <class F>
+class TryTransformGate: IGate
+{
+    F m_func;
+
+    template <class T>
+    using result_t = rm_cvref_t<std::result_of_t<const F&(T)>>;
+
+    // func と下流が例外を投げなければエラーの経路も含めて例外を投げない
+    template <class T, class CB>
+    using is_nothrow_next = std::integral_constant<bool,
+        noexcept(std::declval<const F&>()(std::declval<T>()))
+        && std::is_nothrow_move_constructible<result_t<T>>::value
+        && noexcept(std::declval<CB>()(std::declval<typename result_t<T>::value_type>()))
+        && noexcept(std::declval<CB>()(unexpected(std::declval<typename result_t<T>::error_type>())))>;
+
+public:
+    constexpr TryTransformGate(F &&func):
+        m_func(std::forward<F>(func))
+    { }
+
+    using IGate::OnConnect;
+
+    template <class T>
+    constexpr auto GetInfo(const SourceInfo<T> &info) const
+    {
+        static_assert(is_expected<result_t<T>>::value, "try_transform requires a function returning fet::expected<T, E>");
+        return SourceInfo<typename result_t<T>::value_type> {
+            . capacity = info.capacity,
+        };
+    }
+
+    template <class E, class CB>
+    constexpr void OnNext(std::nullptr_t, E &&e, CB &&cb) const noexcept(is_nothrow_next<E, CB>::value)
+    {
+        auto r = m_func(std::forward<E>(e));
+        if (r) {
+            std::forward<CB>(cb)(std::move(r).value());
+        } else {
+            std::forward<CB>(cb)(unexpected(std::move(r).error()));
+        }
+    }
+};
+
+// func は fet::expected<T, E> を返す
+// 成功なら T を、失敗なら Unexpected<E> を下流に流す (例外は使わない)
+// エラーは OnError() を持たない gate を素通りし、on_error() で受け取れる
+// on_error() を通らずに drain に届いたエラーは捨てられる
+template <class F>
+constexpr TryTransformGate<F> try_transform(F &&func)
+{
+    return { std::forward<F>(func) };
+}
+
+// 自己検査: noexcept な func と drain をつなぐとエラーの経路も含めて全体が noexcept になる
+namespace nothrow_check
+{
+
+struct Parse
+{
+    Expected<int, int> operator ()(int) const noexcept;
+};
+
+struct Sink: IDrain
+{
+    template <class E>
+    size_t OnConnect(const SourceInfo<E>&) const;
+
+    void OnNext(size_t&, int) const noexcept;
+
+    size_t OnComplete(size_t&&) const;
+};
+
+using pipeline_t = Drain<TryTransformGate<Parse>, Sink>;
+using ctx_t = decltype(std::declval<const pipeline_t&>().OnConnect(SourceInfo<int> {}));
+
+static_assert(noexcept(std::declval<const pipeline_t&>().OnNext(std::declval<ctx_t&>(), 0)), "try_transform() with a noexcept function and drain must be noexcept end to end");
+
+} // namespace nothrow_check
+
+template <class A, class B>
+class AffineGate: IGate
+{
+    A m_a;
+    B m_b;
+
+public:
+    constexpr AffineGate(A a, B b):
+        m_a (a),
+        m_b (b)
+    { }
+
+    constexpr const A &slope() const { return m_a; }
+
+    constexpr const B &intercept() const { return m_b; }
+
+    using IGate::OnConnect;
+
+    template <class T>
+    constexpr auto GetInfo(const SourceInfo<T> &info) const
+    {
+        return SourceInfo<decltype(m_a * std::declval<T>() + m_b)> {
+            . capacity = info.capacity,
+        };
+    }
+
+    template <class E, class CB>
+    constexpr void OnNext(std::nullptr_t, E &&e, CB &&cb) const
+    {
+        std::forward<CB>(cb)(m_a * std::forward<E>(e) + m_b);
+    }
+};
+
+// transform([](auto x) { return a * x + b; }) と同じ
+// 数値の範囲 source (iota, repeat) の直後では範囲そのものに畳み込まれる
+template <class A, class B>
+constexpr AffineGate<A, B> affine(A a, B b)
+{
+    return { a, b };
+}
+
 // keySelector に指定するラムダの制約
 // - (auto &&e) の様に参照型(右/左辺値参照)を引数とすること ※ (auto e) の様な値型引数は禁止
 // - e が右辺値参照の場合 e のメンバへの参照を返してはならない
@@ -100,6 +227,8 @@ constexpr auto tuple_transform(F&& ... func)
 } // namespace impl
 
 using impl::transform;
+using impl::affine;
+using impl::try_transform;
 using impl::pair_transform;
 using impl::tuple_transform;
 
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <iterator>
+
+#include "core.hpp"
+#include "source/container_source.hpp"
+
+/* ****************************************************************
+    追記のみのコンテナに対するインクリメンタル実行
+    auto inc = incremental(from_container(log) | filter(f) | transform(g), accumulate(0, op));
+    auto r1 = inc.refresh(); // log 全体を処理
+    log.push_back(...);
+    auto r2 = inc.refresh(); // 追加された要素だけを処理
+
+    gate と drain のコンテキストは refresh() をまたいで保持される
+    drain が OnPeek() を持てば (to_vector() など) 結果はコンテキストへの const 参照
+    そうでなければコンテキストのコピーに OnComplete() して作るので
+    コンテキストはコピー可能であること
+**************************************************************** */
+namespace fet
+{
+
+namespace impl
+{
+
+template <class C, class D>
+class IncrementalPipeline
+{
+    static_assert(std::is_lvalue_reference<C>::value, "incremental requires a container held by reference");
+
+    using value_type = typename rm_cvref_t<C>::value_type;
+    using ctx_t = decltype(std::declval<const D&>().OnConnect(std::declval<SourceInfo<value_type>>()));
+
+    C m_ctr;
+    D m_drain;
+    ctx_t m_ctx;
+    size_t m_offset = 0;
+
+public:
+    IncrementalPipeline(C &&ctr, D &&drain):
+        m_ctr   (std::forward<C>(ctr)),
+        m_drain (std::move(drain)),
+        m_ctx   (m_drain.OnConnect(SourceInfo<value_type> { static_cast<size_t>(m_ctr.size()) }))
+    { }
+
+    // 処理済みの要素数
+    size_t offset() const { return m_offset; }
+
+    // 前回以降に追加された要素を流し、更新後の結果を返す
+    decltype(auto) refresh() {
+        const auto last = std::end(m_ctr);
+        for (auto it = std::next(std::begin(m_ctr), m_offset); it != last; ++it, ++m_offset) {
+            m_drain.OnNext(m_ctx, *it);
+        }
+        return result();
+    }
+
+    // 処理済みの要素までの結果 (要素は流さない)
+    // OnPeek() で返る参照は次の refresh() まで有効
+    template <class X = D, enable_if<can_peek<X, ctx_t>> = nullptr>
+    decltype(auto) result() const {
+        return drain_peek(m_drain, m_ctx);
+    }
+
+    template <class X = D, enable_if<std::integral_constant<bool, !can_peek<X, ctx_t>::value>> = nullptr>
+    decltype(auto) result() const {
+        return m_drain.OnComplete(ctx_t(m_ctx));
+    }
+};
+
+template <class C, class D, enable_if<is_drain<D>> = nullptr>
+IncrementalPipeline<C, rm_cvref_t<D>> incremental(ContainerSource<C> &&src, D &&drain)
+{
+    return { std::move(src).container(), rm_cvref_t<D>(std::forward<D>(drain)) };
+}
+
+// source | gate... は gate 群を drain 側に付け替える
+template <class S, class G, class D, enable_if<is_drain<D>> = nullptr>
+auto incremental(Source<S, G> &&src, D &&drain)
+{
+    auto &s = src;
+    return incremental(std::move(s).upstream(), std::move(src).gate() | std::forward<D>(drain));
+}
+
+} // namespace impl
+
+using impl::incremental;
+
+} // namespace fet
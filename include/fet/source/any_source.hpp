@@ -0,0 +1,150 @@
+#pragma once
+
+#include "../any_stage.hpp"
+#include "../core.hpp"
+
+namespace fet
+{
+
+namespace impl
+{
+
+// 型消去した source から batch 単位で要素を受け取る
+template <class T>
+class IBatchSink
+{
+public:
+    // [first, first + n) の要素は move してよい
+    virtual void OnBatch(T *first, size_t n) = 0;
+
+protected:
+    ~IBatchSink() = default;
+};
+
+template <class T>
+class BatchJunction: IJunction
+{
+    IBatchSink<T> &m_sink;
+    size_t m_batch;
+
+public:
+    BatchJunction(IBatchSink<T> &sink, size_t batch):
+        m_sink  (sink),
+        m_batch (batch)
+    { }
+
+    template <class E>
+    std::vector<T> OnConnect(const SourceInfo<E>&) const
+    {
+        std::vector<T> buf;
+        buf.reserve(m_batch);
+        return buf;
+    }
+
+    template <class E>
+    void OnNext(std::vector<T> &ctx, E &&e) const
+    {
+        ctx.emplace_back(std::forward<E>(e));
+        if (ctx.size() >= m_batch) {
+            Flush(ctx);
+        }
+    }
+
+    void Flush(std::vector<T> &ctx) const
+    {
+        if (!ctx.empty()) {
+            m_sink.OnBatch(ctx.data(), ctx.size());
+            ctx.clear();
+        }
+    }
+};
+
+template <class T>
+class IAnySource: public IAny
+{
+public:
+    virtual SourceInfo<T> GetInfo() const = 0;
+
+    virtual void Emit(IBatchSink<T> &sink, size_t batch) const = 0;
+};
+
+template <class T, class S>
+class AnySourceImpl: public AnyImpl<IAnySource<T>, AnySourceImpl<T, S>>
+{
+    S m_src;
+
+public:
+    AnySourceImpl(S &&src):
+        m_src(std::move(src))
+    { }
+
+    SourceInfo<T> GetInfo() const override
+    {
+        return { m_src.GetInfo().capacity };
+    }
+
+    void Emit(IBatchSink<T> &sink, size_t batch) const override
+    {
+        BatchJunction<T> jct(sink, batch);
+        auto ctx = m_src.Emit(jct);
+        jct.Flush(ctx);
+    }
+};
+
+template <class J, class CTX, class T>
+class BatchSink: public IBatchSink<T>
+{
+    J &m_jct;
+    CTX &m_ctx;
+
+public:
+    BatchSink(J &jct, CTX &ctx):
+        m_jct (jct),
+        m_ctx (ctx)
+    { }
+
+    void OnBatch(T *first, size_t n) override
+    {
+        for (auto last = first + n; first != last; ++first) {
+            m_jct.OnNext(m_ctx, std::move(*first));
+        }
+    }
+};
+
+// source を型消去する
+// 要素は batch 個ずつ溜めてから仮想関数 1 回で下流に渡される
+template <class T>
+class AnySource: ISource
+{
+    AnyBox<IAnySource<T>> m_impl;
+    size_t m_batch;
+
+public:
+    using value_type = T;
+
+    template <class S, enable_if<is_src<S>, std::integral_constant<bool, !std::is_same<rm_cvref_t<S>, AnySource>::value>> = nullptr>
+    AnySource(S &&src, size_t batch = any_batch_size):
+        m_impl  (AnyBox<IAnySource<T>>::template make<AnySourceImpl<T, rm_cvref_t<S>>>(rm_cvref_t<S>(std::forward<S>(src)))),
+        m_batch (batch ? batch : 1)
+    { }
+
+    SourceInfo<value_type> GetInfo() const
+    {
+        return m_impl->GetInfo();
+    }
+
+    template <class J, enable_if<is_jct<J>> = nullptr>
+    decltype(auto) Emit(J && jct) const {
+        decltype(auto) ctx = jct.OnConnect(GetInfo());
+        BatchSink<rm_ref_t<J>, decltype(ctx), T> sink(jct, ctx);
+        m_impl->Emit(sink, m_batch);
+        return ctx;
+    }
+};
+
+} // namespace impl
+
+template <class T>
+using any_source = impl::AnySource<T>;
+
+} // namespace fet
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <algorithm>
+#include <iterator>
+#include <tuple>
+
+#include "../core.hpp"
+#include "../gate/project.hpp"
+
+namespace fet
+{
+
+namespace impl
+{
+
+template <class C>
+using column_ref_t = decltype(*std::begin(std::declval<std::conditional_t<std::is_lvalue_reference<C>::value, C, const C&>>()));
+
+template <class... C>
+class ColumnSource: ISource
+{
+    std::tuple<C ...> m_cols;
+
+    template <class J, class CTX, size_t... I>
+    void _Emit(J &jct, CTX &ctx, std::index_sequence<I ...>) const
+    {
+        auto it = std::make_tuple(std::begin(std::get<I>(m_cols))...);
+        for (auto n = GetInfo().capacity; n != 0; --n) {
+            jct.OnNext(ctx, value_type { *std::get<I>(it)... });
+            using expand = int[];
+            (void)expand { 0, (++std::get<I>(it), 0)... };
+        }
+    }
+
+    template <size_t... I>
+    constexpr size_t _Size(std::index_sequence<I ...>) const
+    {
+        return std::min({ static_cast<size_t>(std::get<I>(m_cols).size())... });
+    }
+
+public:
+    // 各カラムの要素への参照の tuple
+    using value_type = std::tuple<column_ref_t<C>...>;
+
+    constexpr ColumnSource(C&& ... cols):
+        m_cols(std::forward<C>(cols)...)
+    { }
+
+    constexpr SourceInfo<value_type> GetInfo() const
+    {
+        return {
+            . capacity = _Size(std::index_sequence_for<C ...>()),
+        };
+    }
+
+    template <class J, enable_if<is_jct<J>> = nullptr>
+    constexpr decltype(auto) Emit(J && jct) const {
+        decltype(auto) ctx = jct.OnConnect(GetInfo());
+        _Emit(jct, ctx, std::index_sequence_for<C ...>());
+        return ctx;
+    }
+
+    // I... 番目のカラムだけを持つ source
+    template <size_t... I>
+    constexpr ColumnSource<std::tuple_element_t<I, std::tuple<C ...>>...> select() &&
+    {
+        return { std::get<I>(std::move(m_cols))... };
+    }
+};
+
+// struct-of-arrays のカラム群から source を生成
+// 要素は各カラムの要素への参照の tuple
+// 参照なので後段が触らないカラムの要素は読み込まれない
+template <class... C>
+constexpr ColumnSource<C ...> from_columns(C&& ... cols)
+{
+    return { std::forward<C>(cols)... };
+}
+
+/* ****************************************************************
+    projection pushdown
+    from_columns() の直後の project<I...>(), transform_fields<I...>() は
+    source 側で不要なカラムを落とし、そのカラムのイテレータを進めることもしない
+ */
+
+template <class... C, size_t... I>
+constexpr auto operator |(ColumnSource<C ...> &&src, ProjectGate<I ...>)
+{
+    return std::move(src).template select<I ...>();
+}
+
+template <class... C, class F, size_t... I>
+constexpr auto operator |(ColumnSource<C ...> &&src, FieldTransformGate<F, I ...> &&gate)
+{
+    return make_src(std::move(src).template select<I ...>(), std::move(gate).rebind(std::make_index_sequence<sizeof...(I)>()));
+}
+
+} // namespace impl
+
+using impl::from_columns;
+
+} // namespace fet
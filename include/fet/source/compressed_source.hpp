@@ -0,0 +1,59 @@
+#pragma once
+
+#include <array>
+
+#include "../compressed_ints.hpp"
+#include "../core.hpp"
+
+namespace fet
+{
+
+namespace impl
+{
+
+template <class C>
+class CompressedSource: ISource
+{
+    C m_ints;
+
+public:
+    using value_type = typename rm_cvref_t<C>::value_type;
+
+    constexpr CompressedSource(C &&ints):
+        m_ints(std::forward<C>(ints))
+    { }
+
+    constexpr SourceInfo<value_type> GetInfo() const
+    {
+        return {
+            . capacity = m_ints.size(),
+        };
+    }
+
+    // ブロック単位で展開し、展開バッファ内の要素を参照で流す
+    template <class J, enable_if<is_jct<J>> = nullptr>
+    decltype(auto) Emit(J && jct) const {
+        decltype(auto) ctx = jct.OnConnect(GetInfo());
+        std::array<value_type, rm_cvref_t<C>::block_size> buf;
+        for (size_t i = 0, blocks = m_ints.block_count(); i < blocks; ++i) {
+            const size_t n = m_ints.decode_block(i, buf.data());
+            for (size_t j = 0; j < n; ++j) {
+                jct.OnNext(ctx, static_cast<const value_type&>(buf[j]));
+            }
+        }
+        return ctx;
+    }
+};
+
+// to_compressed() の結果から source を生成
+template <class C>
+constexpr CompressedSource<C> from_compressed(C &&ints)
+{
+    return { std::forward<C>(ints) };
+}
+
+} // namespace impl
+
+using impl::from_compressed;
+
+} // namespace fet
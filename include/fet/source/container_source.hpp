@@ -1,5 +1,7 @@
 #pragma once
 
+#include <iterator>
+
 #include "../core.hpp"
 
 namespace fet
@@ -44,8 +46,23 @@ public:
         }
         return ctx;
     }
+
+    // 保持しているコンテナを取り出す (source を組み替える pushdown 用)
+    constexpr C &&container() &&
+    {
+        return std::forward<C>(m_ctr);
+    }
+
+    constexpr const rm_ref_t<C> &container() const &
+    {
+        return m_ctr;
+    }
 };
 
+// 添字で要素にアクセスできるコンテナか (pushdown の条件)
+template <class C>
+using is_random_access_ctr = std::is_base_of<std::random_access_iterator_tag, typename std::iterator_traits<decltype(std::begin(std::declval<rm_ref_t<C>&>()))>::iterator_category>;
+
 // コンテナ型から source を生成
 template <class C>
 constexpr ContainerSource<C> from_container(C &&ctr)
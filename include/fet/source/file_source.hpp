@@ -0,0 +1,239 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../core.hpp"
+#include "../drain/to_file.hpp"
+
+namespace fet
+{
+
+namespace impl
+{
+
+/* ****************************************************************
+    ダブルバッファによる先読み
+    パイプラインのスレッドが片方のバッファを処理している間に
+    読み込みスレッドがもう片方に次のチャンクを fread する
+    読み込みエラーと末尾の半端なレコードは、読めた分を渡し終えた後の Next() で例外にする
+ */
+template <class U>
+class ReadAhead
+{
+    std::string m_path;
+    std::FILE *m_fp;
+    const char *m_failure = nullptr;
+    std::vector<U> m_buf[2];
+    size_t m_len[2] = { 0, 0 };
+    bool m_ready[2] = { false, false };
+    size_t m_cur = 1;
+    bool m_held = false;
+    bool m_stop = false;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::thread m_thread;
+
+    void Run()
+    {
+        for (size_t slot = 0;; slot = 1 - slot) {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cv.wait(lock, [&] { return !m_ready[slot] || m_stop; });
+                if (m_stop) {
+                    return;
+                }
+            }
+            // 半端なレコードを検出できるようバイト単位で読む
+            const size_t want = m_buf[slot].size() * sizeof(U);
+            const size_t bytes = std::fread(m_buf[slot].data(), 1, want, m_fp);
+            const size_t n = bytes / sizeof(U);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (bytes < want && !m_failure) {
+                if (std::ferror(m_fp)) {
+                    m_failure = "fet: failed to read '";
+                } else if (bytes % sizeof(U)) {
+                    m_failure = "fet: truncated record at end of '";
+                }
+            }
+            m_len[slot] = n;
+            m_ready[slot] = true;
+            m_cv.notify_all();
+            if (n == 0) {
+                return;
+            }
+        }
+    }
+
+public:
+    ReadAhead(const std::string &path, size_t count):
+        m_path (path),
+        m_fp   (std::fopen(path.c_str(), "rb"))
+    {
+        if (!m_fp) {
+            throw std::runtime_error("fet: cannot open '" + path + "' for reading");
+        }
+        for (auto &buf : m_buf) {
+            buf.resize(count ? count : 1);
+        }
+        m_thread = std::thread([this] { Run(); });
+    }
+
+    ReadAhead(const ReadAhead&) = delete;
+    ReadAhead &operator =(const ReadAhead&) = delete;
+
+    ~ReadAhead()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+            m_cv.notify_all();
+        }
+        m_thread.join();
+        std::fclose(m_fp);
+    }
+
+    // 前のチャンクを返却して次のチャンクを受け取る
+    // 終端なら n == 0 (読み込みエラーや末尾の半端なレコードがあれば例外)
+    const U *Next(size_t &n)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_held) {
+            m_ready[m_cur] = false;
+            m_cv.notify_all();
+        }
+        m_held = true;
+        m_cur = 1 - m_cur;
+        m_cv.wait(lock, [&] { return m_ready[m_cur]; });
+        n = m_len[m_cur];
+        if (n == 0 && m_failure) {
+            throw std::runtime_error(m_failure + m_path + "'");
+        }
+        return m_buf[m_cur].data();
+    }
+};
+
+template <class T, class = void>
+class FileSource: ISource
+{
+    // to_file() と同じ制約 (ポインタや std::string_view をバイト列から読み戻しても意味がない)
+    static_assert(!std::is_pointer<T>::value, "from_file cannot read pointers");
+    static_assert(is_raw_record<T>::value, "from_file requires trivially copyable elements (not views) or owning strings");
+
+    std::string m_path;
+    size_t m_bufsize;
+
+public:
+    using value_type = T;
+
+    FileSource(std::string path, size_t bufsize):
+        m_path    (std::move(path)),
+        m_bufsize (bufsize)
+    { }
+
+    SourceInfo<value_type> GetInfo() const
+    {
+        size_t size = 0;
+        if (auto fp = std::fopen(m_path.c_str(), "rb")) {
+            if (std::fseek(fp, 0, SEEK_END) == 0) {
+                const long pos = std::ftell(fp);
+                size = pos > 0 ? static_cast<size_t>(pos) / sizeof(T) : 0;
+            }
+            std::fclose(fp);
+        }
+        return {
+            . capacity = size,
+        };
+    }
+
+    // 読み込みバッファ内の要素を参照で流す
+    template <class J, enable_if<is_jct<J>> = nullptr>
+    decltype(auto) Emit(J && jct) const {
+        decltype(auto) ctx = jct.OnConnect(GetInfo());
+        ReadAhead<T> reader(m_path, std::max<size_t>(1, m_bufsize / sizeof(T)));
+        size_t n;
+        for (const T *p = reader.Next(n); n != 0; p = reader.Next(n)) {
+            for (auto last = p + n; p != last; ++p) {
+                jct.OnNext(ctx, *p);
+            }
+        }
+        return ctx;
+    }
+};
+
+// to_file() で書き出した文字列を読む
+template <class T>
+class FileSource<T, std::enable_if_t<!std::is_trivially_copyable<T>::value && is_byte_string<T>::value>>: ISource
+{
+    std::string m_path;
+    size_t m_bufsize;
+
+public:
+    using value_type = T;
+
+    FileSource(std::string path, size_t bufsize):
+        m_path    (std::move(path)),
+        m_bufsize (bufsize)
+    { }
+
+    SourceInfo<value_type> GetInfo() const
+    {
+        return {
+            . capacity = 0,
+        };
+    }
+
+    // 1 つの文字列バッファを使い回し、const 参照で流す
+    template <class J, enable_if<is_jct<J>> = nullptr>
+    decltype(auto) Emit(J && jct) const {
+        decltype(auto) ctx = jct.OnConnect(GetInfo());
+        ReadAhead<char> reader(m_path, m_bufsize);
+        T str;
+        uint64_t len = 0;
+        size_t hdr = 0;
+        size_t n;
+        for (const char *p = reader.Next(n); n != 0; p = reader.Next(n)) {
+            for (auto last = p + n; p != last;) {
+                if (hdr < sizeof(len)) {
+                    reinterpret_cast<char *>(&len)[hdr++] = *p++;
+                    if (hdr == sizeof(len)) {
+                        str.clear();
+                    }
+                } else {
+                    const size_t k = std::min<size_t>(len - str.size(), last - p);
+                    str.append(p, k);
+                    p += k;
+                }
+                if (hdr == sizeof(len) && str.size() == len) {
+                    jct.OnNext(ctx, static_cast<const T&>(str));
+                    hdr = 0;
+                }
+            }
+        }
+        if (hdr != 0) {
+            throw std::runtime_error("fet: truncated record at end of '" + m_path + "'");
+        }
+        return ctx;
+    }
+};
+
+// to_file() で書き出したファイルから source を生成
+// 読み込みは別スレッドで先読みされる
+template <class T>
+FileSource<T> from_file(std::string path, size_t bufsize = file_buffer_size)
+{
+    return { std::move(path), bufsize };
+}
+
+} // namespace impl
+
+using impl::from_file;
+
+} // namespace fet
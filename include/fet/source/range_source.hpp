@@ -0,0 +1,282 @@
+#pragma once
+
+#include <cmath>
+#include <stdexcept>
+#include <type_traits>
+
+#include "../core.hpp"
+#include "../drain/accumulate.hpp"
+#include "../gate/transform.hpp"
+
+/* ****************************************************************
+    数値の範囲 source
+    iota(begin, end, step) : 等差数列
+    repeat(value, n)       : 同じ値の繰り返し
+
+    drain に直結した場合は要素ごとのディスパッチをしない
+        sum()      : 閉じた式
+        count()    : 要素数
+        count_if() : 述語だけを回すループ (ベクトル化されやすい)
+    affine(a, b) は範囲そのものに畳み込まれる
+**************************************************************** */
+namespace fet
+{
+
+namespace impl
+{
+
+template <class J, class D>
+using is_jct_of = std::is_same<rm_cvref_t<J>, D>;
+
+template <class J>
+struct is_count_if: std::false_type { };
+
+template <class I, class F>
+struct is_count_if<CountIfDrain<I, F>>: std::true_type { };
+
+template <class J>
+using is_closed_form_jct = std::integral_constant<bool, is_jct_of<J, SumDrain>::value || is_jct_of<J, CountDrain>::value || is_count_if<rm_cvref_t<J>>::value>;
+
+// 整数は符号なしで計算して折り返し、最後に 1 度だけ T に戻す
+// 1 要素ずつ足した場合と同じ値 (mod 2^N) になり、符号付き整数のオーバーフローも起こさない
+// (short などは int に昇格してからオーバーフローしないよう unsigned 以上の幅で計算する)
+template <class T>
+using wrap_t = std::common_type_t<std::make_unsigned_t<T>, unsigned>;
+
+template <class T, enable_if<std::is_integral<T>> = nullptr>
+constexpr T wrap_add(const T &a, const T &b)
+{
+    return static_cast<T>(static_cast<wrap_t<T>>(a) + static_cast<wrap_t<T>>(b));
+}
+
+template <class T, enable_if<std::integral_constant<bool, !std::is_integral<T>::value>> = nullptr>
+constexpr T wrap_add(const T &a, const T &b)
+{
+    return a + b;
+}
+
+template <class T, enable_if<std::is_integral<T>> = nullptr>
+constexpr T wrap_mul(const T &a, const T &b)
+{
+    return static_cast<T>(static_cast<wrap_t<T>>(a) * static_cast<wrap_t<T>>(b));
+}
+
+template <class T, enable_if<std::integral_constant<bool, !std::is_integral<T>::value>> = nullptr>
+constexpr T wrap_mul(const T &a, const T &b)
+{
+    return a * b;
+}
+
+// 0 + 1 + ... + (n - 1)
+template <class T, enable_if<std::is_integral<T>> = nullptr>
+constexpr T triangular(size_t n)
+{
+    using W = wrap_t<T>;
+    return static_cast<T>(n % 2 == 0 ? static_cast<W>(n / 2) * static_cast<W>(n - 1) : static_cast<W>(n) * static_cast<W>((n - 1) / 2));
+}
+
+template <class T, enable_if<std::is_floating_point<T>> = nullptr>
+constexpr T triangular(size_t n)
+{
+    return static_cast<T>(n) * static_cast<T>(n == 0 ? 0 : n - 1) / 2;
+}
+
+template <class T, enable_if<std::is_integral<T>> = nullptr>
+constexpr T times(size_t n, const T &v)
+{
+    using W = wrap_t<T>;
+    return static_cast<T>(static_cast<W>(n) * static_cast<W>(v));
+}
+
+template <class T, enable_if<std::integral_constant<bool, !std::is_integral<T>::value>> = nullptr>
+constexpr T times(size_t n, const T &v)
+{
+    return static_cast<T>(n) * v;
+}
+
+// [begin, end) を step 刻みにした要素数
+// 整数は end - begin が T に収まらなくてもよいよう符号なしで差を取る
+template <class T, enable_if<std::is_integral<T>> = nullptr>
+size_t iota_count(T begin, T end, T step)
+{
+    using W = wrap_t<T>;
+    if (step > 0 && end > begin) {
+        return static_cast<size_t>((static_cast<W>(end) - static_cast<W>(begin) - 1) / static_cast<W>(step)) + 1;
+    }
+    if (step < 0 && end < begin) {
+        return static_cast<size_t>((static_cast<W>(begin) - static_cast<W>(end) - 1) / (W(0) - static_cast<W>(step))) + 1;
+    }
+    return 0;
+}
+
+template <class T, enable_if<std::is_floating_point<T>> = nullptr>
+size_t iota_count(T begin, T end, T step)
+{
+    const auto k = std::ceil((end - begin) / step);
+    return k > 0 ? static_cast<size_t>(k) : 0;
+}
+
+template <class T>
+class IotaSource: ISource
+{
+    static_assert(std::is_arithmetic<T>::value, "iota requires an arithmetic type");
+
+    T m_first;
+    T m_step;
+    size_t m_count;
+
+    constexpr T At(size_t i) const
+    {
+        return wrap_add(m_first, times(i, m_step));
+    }
+
+public:
+    using value_type = T;
+
+    constexpr IotaSource(T first, T step, size_t count):
+        m_first (first),
+        m_step  (step),
+        m_count (count)
+    { }
+
+    constexpr T first() const { return m_first; }
+
+    constexpr T step() const { return m_step; }
+
+    constexpr SourceInfo<value_type> GetInfo() const
+    {
+        return {
+            . capacity = m_count,
+        };
+    }
+
+    template <class J, enable_if<is_jct<J>, std::integral_constant<bool, !is_closed_form_jct<J>::value>> = nullptr>
+    decltype(auto) Emit(J && jct) const {
+        decltype(auto) ctx = jct.OnConnect(GetInfo());
+        for (size_t i = 0; i < m_count; ++i) {
+            jct.OnNext(ctx, At(i));
+        }
+        return ctx;
+    }
+
+    template <class J, enable_if<is_jct_of<J, SumDrain>> = nullptr>
+    constexpr T Emit(J&&) const
+    {
+        return wrap_add(times(m_count, m_first), wrap_mul(m_step, triangular<T>(m_count)));
+    }
+
+    template <class J, enable_if<is_jct_of<J, CountDrain>> = nullptr>
+    constexpr size_t Emit(J&&) const
+    {
+        return m_count;
+    }
+
+    template <class J, enable_if<is_count_if<rm_cvref_t<J>>> = nullptr>
+    auto Emit(J && jct) const
+    {
+        auto ctx = jct.OnConnect(GetInfo());
+        const auto &pred = jct.predicate();
+        size_t n = 0;
+        for (size_t i = 0; i < m_count; ++i) {
+            n += pred(At(i)) ? 1 : 0;
+        }
+        ctx += n;
+        return ctx;
+    }
+};
+
+template <class T>
+class RepeatSource: ISource
+{
+    T m_value;
+    size_t m_count;
+
+public:
+    using value_type = T;
+
+    constexpr RepeatSource(T value, size_t count):
+        m_value (std::move(value)),
+        m_count (count)
+    { }
+
+    constexpr const T &value() const { return m_value; }
+
+    constexpr SourceInfo<value_type> GetInfo() const
+    {
+        return {
+            . capacity = m_count,
+        };
+    }
+
+    template <class J, enable_if<is_jct<J>, std::integral_constant<bool, !is_closed_form_jct<J>::value>> = nullptr>
+    decltype(auto) Emit(J && jct) const {
+        decltype(auto) ctx = jct.OnConnect(GetInfo());
+        for (size_t i = 0; i < m_count; ++i) {
+            jct.OnNext(ctx, m_value);
+        }
+        return ctx;
+    }
+
+    template <class J, enable_if<is_jct_of<J, SumDrain>> = nullptr>
+    constexpr T Emit(J&&) const
+    {
+        return times(m_count, m_value);
+    }
+
+    template <class J, enable_if<is_jct_of<J, CountDrain>> = nullptr>
+    constexpr size_t Emit(J&&) const
+    {
+        return m_count;
+    }
+
+    template <class J, enable_if<is_count_if<rm_cvref_t<J>>> = nullptr>
+    auto Emit(J && jct) const
+    {
+        auto ctx = jct.OnConnect(GetInfo());
+        if (jct.predicate()(m_value)) {
+            ctx += m_count;
+        }
+        return ctx;
+    }
+};
+
+// a * x + b を範囲に畳み込む
+template <class T, class A, class B>
+constexpr auto operator |(IotaSource<T> &&src, AffineGate<A, B> &&gate)
+{
+    using R = decltype(gate.slope() * src.first() + gate.intercept());
+    const R a = gate.slope();
+    return IotaSource<R>(wrap_add(wrap_mul(a, R(src.first())), R(gate.intercept())), wrap_mul(a, R(src.step())), src.GetInfo().capacity);
+}
+
+template <class T, class A, class B>
+constexpr auto operator |(RepeatSource<T> &&src, AffineGate<A, B> &&gate)
+{
+    using R = decltype(gate.slope() * src.value() + gate.intercept());
+    return RepeatSource<R>(wrap_add(wrap_mul(R(gate.slope()), R(src.value())), R(gate.intercept())), src.GetInfo().capacity);
+}
+
+// [begin, end) を step 刻みで生成する (step は負でもよい)
+template <class T, class S = T>
+IotaSource<T> iota(T begin, T end, S step = 1)
+{
+    const T s = static_cast<T>(step);
+    if (s == 0) {
+        throw std::invalid_argument("fet: iota step must not be zero");
+    }
+    return { begin, s, iota_count(begin, end, s) };
+}
+
+// value を n 回生成する
+template <class T>
+constexpr RepeatSource<std::decay_t<T>> repeat(T &&value, size_t n)
+{
+    return { std::forward<T>(value), n };
+}
+
+} // namespace impl
+
+using impl::iota;
+using impl::repeat;
+
+} // namespace fet
@@ -0,0 +1,202 @@
+#pragma once
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "../core.hpp"
+#include "../checkpoint.hpp"
+#include "container_source.hpp"
+
+/* ****************************************************************
+    チェックポイントから再開できる source
+    auto r = resumable(from_container(data), 1000000, save) | filter(f) | sum();
+    save(blob) には every 個消費するごとに (消費した要素数, 下流の全コンテキスト) が渡される
+    再開時は最後の blob を渡すと、コンテキストを戻して続きの要素から流す
+
+    下流の gate と drain のコンテキストはすべて checkpoint_codec に対応していること
+    source は再実行しても同じ順序で同じ要素を出すこと
+**************************************************************** */
+namespace fet
+{
+
+namespace impl
+{
+
+constexpr uint64_t checkpoint_format = 1;
+
+template <class J, class CTX, class F>
+class ResumeJunction: IJunction
+{
+    const J &m_jct;
+    CTX &m_ctx;
+    const F &m_save;
+    size_t m_every;
+    mutable size_t m_pos;
+    mutable size_t m_skip;
+    mutable CheckpointWriter m_writer;
+
+    void Save() const
+    {
+        m_writer.clear();
+        checkpoint_put(m_writer, checkpoint_format);
+        checkpoint_put(m_writer, m_pos);
+        checkpoint_put(m_writer, m_ctx);
+        m_save(m_writer.data());
+    }
+
+public:
+    ResumeJunction(const J &jct, CTX &ctx, const F &save, size_t every, size_t pos, size_t skip):
+        m_jct   (jct),
+        m_ctx   (ctx),
+        m_save  (save),
+        m_every (every),
+        m_pos   (pos),
+        m_skip  (skip)
+    { }
+
+    using IJunction::OnConnect;
+
+    template <class E>
+    void OnNext(std::nullptr_t, E &&e) const
+    {
+        if (m_skip) {
+            --m_skip;
+            return;
+        }
+        m_jct.OnNext(m_ctx, std::forward<E>(e));
+        if (m_every && ++m_pos % m_every == 0) {
+            Save();
+        }
+    }
+};
+
+// 添字で再開位置まで飛べる source
+template <class S>
+struct is_indexed_src: std::false_type { };
+
+template <class C>
+struct is_indexed_src<ContainerSource<C>>: is_random_access_ctr<C> { };
+
+template <class S, class F>
+class ResumableSource: ISource
+{
+    S m_src;
+    F m_save;
+    size_t m_every;
+    std::string m_checkpoint;
+
+    template <class CTX>
+    size_t Restore(CTX &ctx) const
+    {
+        if (m_checkpoint.empty()) {
+            return 0;
+        }
+        CheckpointReader r(m_checkpoint);
+        uint64_t format;
+        size_t pos;
+        checkpoint_get(r, format);
+        if (format != checkpoint_format) {
+            throw std::runtime_error("fet: unsupported checkpoint format");
+        }
+        checkpoint_get(r, pos);
+        checkpoint_get(r, ctx);
+        if (!r.empty()) {
+            throw std::runtime_error("fet: checkpoint does not match the pipeline");
+        }
+        return pos;
+    }
+
+    template <class SRC, class RJ, enable_if<is_indexed_src<rm_cvref_t<SRC>>> = nullptr>
+    static void EmitFrom(SRC &&src, const RJ &rj, size_t pos)
+    {
+        decltype(auto) ctr = std::forward<SRC>(src).container();
+        using elem_t = std::conditional_t<std::is_lvalue_reference<decltype(std::forward<SRC>(src).container())>::value, decltype(*std::begin(ctr)), decltype(std::move(*std::begin(ctr)))>;
+        const size_t n = ctr.size();
+        const auto first = std::begin(ctr);
+        for (size_t i = std::min(pos, n); i < n; ++i) {
+            rj.OnNext(nullptr, static_cast<elem_t>(first[i]));
+        }
+    }
+
+    // 再開位置までは要素を読み捨てる
+    template <class SRC, class RJ, enable_if<std::integral_constant<bool, !is_indexed_src<rm_cvref_t<SRC>>::value>> = nullptr>
+    static void EmitFrom(SRC &&src, const RJ &rj, size_t)
+    {
+        std::forward<SRC>(src).Emit(rj);
+    }
+
+    template <class J, class SRC>
+    auto _Emit(const J &jct, SRC &&src) const
+    {
+        auto ctx = jct.OnConnect(GetInfo());
+        const size_t pos = Restore(ctx);
+        const size_t skip = is_indexed_src<rm_cvref_t<SRC>>::value ? 0 : pos;
+        ResumeJunction<J, decltype(ctx), rm_ref_t<F>> rj(jct, ctx, m_save, m_every, pos, skip);
+        EmitFrom(std::forward<SRC>(src), rj, pos);
+        return ctx;
+    }
+
+public:
+    using value_type = typename rm_cvref_t<S>::value_type;
+
+    ResumableSource(S &&src, F &&save, size_t every, std::string &&checkpoint):
+        m_src        (std::forward<S>(src)),
+        m_save       (std::forward<F>(save)),
+        m_every      (every),
+        m_checkpoint (std::move(checkpoint))
+    { }
+
+    constexpr SourceInfo<value_type> GetInfo() const
+    {
+        return m_src.GetInfo();
+    }
+
+    template <class J, enable_if<is_jct<J>> = nullptr>
+    decltype(auto) Emit(J && jct) const & {
+        return _Emit(jct, m_src);
+    }
+
+    template <class J, enable_if<is_jct<J>> = nullptr>
+    decltype(auto) Emit(J && jct) && {
+        return _Emit(jct, std::forward<S>(m_src));
+    }
+};
+
+// every 個消費するごとに onCheckpoint(const std::string &blob) を呼ぶ (0 なら呼ばない)
+// checkpoint に以前の blob を渡すとそこから再開する (空なら最初から)
+// 例: auto total = resumable(from_container(rows), 1000000, [&](const std::string &b) { store(b); }, load()) | transform(f) | sum();
+template <class S, class F, enable_if<is_src<S>> = nullptr>
+ResumableSource<S, F> resumable(S &&src, size_t every, F &&onCheckpoint, std::string checkpoint = std::string())
+{
+    return { std::forward<S>(src), std::forward<F>(onCheckpoint), every, std::move(checkpoint) };
+}
+
+// source | gate... は元の source の位置を記録し、gate のコンテキストもチェックポイントに含める
+template <class S, class G, class F>
+auto resumable(Source<S, G> &&src, size_t every, F &&onCheckpoint, std::string checkpoint = std::string())
+{
+    auto &s = src;
+    return resumable(std::move(s).upstream(), every, std::forward<F>(onCheckpoint), std::move(checkpoint)) | std::move(src).gate();
+}
+
+// blob を作った時点で消費済みだった source の要素数
+inline size_t checkpoint_position(const std::string &checkpoint)
+{
+    CheckpointReader r(checkpoint);
+    uint64_t format;
+    size_t pos;
+    checkpoint_get(r, format);
+    if (format != checkpoint_format) {
+        throw std::runtime_error("fet: unsupported checkpoint format");
+    }
+    checkpoint_get(r, pos);
+    return pos;
+}
+
+} // namespace impl
+
+using impl::checkpoint_position;
+using impl::resumable;
+
+} // namespace fet
@@ -28,6 +28,10 @@ using rm_ref_t = std::remove_reference_t<T>;
 template <class T>
 using rm_cvref_t = std::remove_cv_t<rm_ref_t<T>>;
 
+// 使われた時だけ失敗させる static_assert 用
+template <class... T>
+struct dependent_false: std::false_type { };
+
 template <class T>
 using rm_rref_t = std::conditional_t<std::is_rvalue_reference<T>::value, rm_ref_t<T>, T>;
 
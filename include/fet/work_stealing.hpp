@@ -0,0 +1,196 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* ****************************************************************
+    ワークスティーリングによるタスク実行
+    ワーカーごとに deque を持ち、自分の deque は後ろから (LIFO)
+    他のワーカーの deque は前から (FIFO) 盗む
+    投入されたタスクは各ワーカーに順に配る
+**************************************************************** */
+namespace fet
+{
+
+namespace impl
+{
+
+class IParTask
+{
+public:
+    virtual ~IParTask() = default;
+
+    // worker: 実行しているワーカーの番号
+    virtual void Run(size_t worker) = 0;
+};
+
+class WorkStealingPool
+{
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<std::unique_ptr<IParTask>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    size_t m_limit;
+    size_t m_queued = 0;     // 取り出されていないタスク数
+    size_t m_running = 0;    // 投入されて終わっていないタスク数
+    size_t m_next = 0;
+    bool m_closed = false;
+    std::exception_ptr m_error;
+
+    std::unique_ptr<IParTask> Take(size_t worker)
+    {
+        const size_t n = m_queues.size();
+        for (;;) {
+            {
+                auto &q = *m_queues[worker];
+                std::lock_guard<std::mutex> lock(q.mutex);
+                if (!q.tasks.empty()) {
+                    auto task = std::move(q.tasks.back());
+                    q.tasks.pop_back();
+                    return task;
+                }
+            }
+            for (size_t i = 1; i < n; ++i) {
+                auto &q = *m_queues[(worker + i) % n];
+                std::lock_guard<std::mutex> lock(q.mutex);
+                if (!q.tasks.empty()) {
+                    auto task = std::move(q.tasks.front());
+                    q.tasks.pop_front();
+                    return task;
+                }
+            }
+            // 予約済みのタスクは必ずどこかの deque にあるので探し直す
+            std::this_thread::yield();
+        }
+    }
+
+    void Run(size_t worker)
+    {
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cv.wait(lock, [&] { return m_queued || m_closed; });
+                if (!m_queued) {
+                    return;
+                }
+                --m_queued;
+            }
+            auto task = Take(worker);
+            std::exception_ptr error;
+            try {
+                task->Run(worker);
+            } catch (...) {
+                error = std::current_exception();
+            }
+            task.reset();
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (error && !m_error) {
+                m_error = error;
+            }
+            --m_running;
+            m_cv.notify_all();
+        }
+    }
+
+public:
+    // threads: ワーカー数 (0 ならハードウェアスレッド数)
+    // limit  : 終わっていないタスクがこれを超えると Submit() は待つ
+    explicit WorkStealingPool(size_t threads, size_t limit = 0)
+    {
+        if (threads == 0) {
+            threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+        }
+        m_limit = limit ? limit : threads * 64;
+        for (size_t i = 0; i < threads; ++i) {
+            m_queues.push_back(std::make_unique<Queue>());
+        }
+        for (size_t i = 0; i < threads; ++i) {
+            m_threads.emplace_back([this, i] { Run(i); });
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool &operator =(const WorkStealingPool&) = delete;
+
+    ~WorkStealingPool()
+    {
+        Close();
+    }
+
+    size_t size() const { return m_queues.size(); }
+
+    void Submit(std::unique_ptr<IParTask> task)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [&] { return m_running < m_limit; });
+        const size_t i = m_next++ % m_queues.size();
+        {
+            auto &q = *m_queues[i];
+            std::lock_guard<std::mutex> qlock(q.mutex);
+            q.tasks.push_back(std::move(task));
+        }
+        ++m_queued;
+        ++m_running;
+        m_cv.notify_all();
+    }
+
+    // Submit() が待たずに投入できる状態になるまで最大 timeout 待つ
+    template <class R, class P>
+    bool WaitAvailable(const std::chrono::duration<R, P> &timeout)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return m_cv.wait_for(lock, timeout, [&] { return m_running < m_limit; });
+    }
+
+    // 投入済みのタスクがすべて終わるまで最大 timeout 待つ
+    template <class R, class P>
+    bool WaitIdle(const std::chrono::duration<R, P> &timeout)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return m_cv.wait_for(lock, timeout, [&] { return m_running == 0; });
+    }
+
+    // 全タスクの完了を待ってワーカーを止める
+    // タスクが例外を投げていたら最初の 1 つを投げ直す
+    void Close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_closed) {
+                return;
+            }
+            m_closed = true;
+            m_cv.notify_all();
+        }
+        for (auto &t : m_threads) {
+            t.join();
+        }
+    }
+
+    void Rethrow()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_error) {
+            auto error = m_error;
+            m_error = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+};
+
+} // namespace impl
+
+} // namespace fet